@@ -3,19 +3,32 @@
 
 #include "sfs_types.h"
 #include <sys/stat.h>
+#include <sys/types.h>
+#include <stdio.h>
 
 //====== open and close ======
 int sfs_open_fs(sfs_t *filesystem,const char *path,int flags);
 int sfs_close_fs(sfs_t *filesystem,int flags);
+//formats a new filesystem of page_count pages at path (replacing anything there) and leaves it open
+//a page_count of 0 fills the existing file or block device
+//only the superblock and root are written, pages are handed out from the high water mark upwards
+int sfs_create_fs(sfs_t *filesystem,const char *path,uint64_t page_count,int flags);
 
 //====== page management ======
-//works even if the page was never allocated
+//the page must have been allocated (pages at or above the high water mark fail with EINVAL, as they would be handed out twice)
 int sfs_free_page(sfs_t *filesystem,uint64_t page);
 //returns allocated page index and removes it from the list of free pages
 uint64_t sfs_allocate_page(sfs_t *filesystem); 
+//puts the free pages libsfs is holding in memory back on the on disk free list (sfs_close_fs does this too)
+int sfs_flush_free_pages(sfs_t *filesystem);
 //places the file cursor at the begining of the given page
 int sfs_seek_to_page(sfs_t *filesystem,uint64_t page);
 
+//reads / writes len bytes at a byte offset into the image (e.g. from sfs_file_map)
+//use these rather than the fd, so SFS_FUNC_FLAG_DIRECT_IO images get aligned transfers
+int sfs_image_read(sfs_t *filesystem,void *buffer,size_t len,uint64_t offset);
+int sfs_image_write(sfs_t *filesystem,const void *buffer,size_t len,uint64_t offset);
+
 //--- offset finding ---
 //successor to sfs_seek_to_page
 uint64_t sfs_page_offset(sfs_t *filesystem,uint64_t page);
@@ -38,6 +51,10 @@ int sfs_inode_seek_to_pointer(sfs_t *filesystem,uint64_t inode,uint64_t index);
 int sfs_inode_set_pointer(sfs_t *filesystem,uint64_t inode,uint64_t index,uint64_t pointer);
 //the same as the set pointer function but returns the pointer value
 uint64_t sfs_inode_get_pointer(sfs_t *filesystem,uint64_t inode,uint64_t index);
+//read / write count pointers starting at index start into / from pointers[], with one I/O per inode page they are on
+//much cheaper than a get / set per pointer when going through a directory or a file
+int sfs_inode_get_pointers(sfs_t *filesystem,uint64_t inode,uint64_t start,uint64_t count,uint64_t pointers[]);
+int sfs_inode_set_pointers(sfs_t *filesystem,uint64_t inode,uint64_t start,uint64_t count,const uint64_t pointers[]);
 //changes the inode header to reflect the new number and removes or adds continuation pages to fit the new count
 int sfs_inode_realocate_pointers(sfs_t *filesystem,uint64_t inode,uint64_t count);
 // O(1) removal by replacing the requested pointer with the last pointer and decrementing the pointer count
@@ -47,6 +64,11 @@ int sfs_inode_remove_pointer(sfs_t *filesystem,uint64_t inode,uint64_t index);
 int sfs_inode_add_pointer(sfs_t *filesystem,uint64_t inode,uint64_t pointer);
 //creates an inode under a parent inode and returns the inode number of the created node
 uint64_t sfs_inode_create(sfs_t *filesystem,const char *name,mode_t mode,uid_t uid,gid_t gid,uint64_t parent);
+//renames the inode at old_index in old_parent to new_name in new_parent, updating its header
+//new_index as (uint64_t)-1 adds it to the end of new_parent, otherwise it takes that slot and the inode that was there is then put on the orphan list
+int sfs_inode_move(sfs_t *filesystem,uint64_t inode,uint64_t old_parent,uint64_t old_index,uint64_t new_parent,uint64_t new_index,const char *new_name);
+//swaps two directory entries, each inode taking the other's name and parent
+int sfs_inode_exchange(sfs_t *filesystem,uint64_t parent_a,uint64_t index_a,uint64_t parent_b,uint64_t index_b);
 
 //====== regular files ======
 //does both truncate and extending to change file size to new size
@@ -55,12 +77,36 @@ int sfs_file_resize(sfs_t *filesystem,uint64_t inode,uint64_t new_size,int64_t b
 //read and write return (size_t)-1 on error
 size_t sfs_file_read(sfs_t *filesystem,uint64_t inode,off_t offset,char buffer[],size_t len);
 size_t sfs_file_write(sfs_t *filesystem,uint64_t inode,off_t offset,const char buffer[],size_t len);
+//resizes the file (zeroing any gap) so that len bytes can be written at offset
+int sfs_file_grow_for_write(sfs_t *filesystem,uint64_t inode,off_t offset,size_t len);
+//finds where len bytes from offset live in the image, merging pages that are next to each other
+//len is clamped to the end of the file. returns the number of extents filled, or -1 on error (ENOBUFS if max_extents is too small)
+//a range spanning n pages never needs more than n extents
+ssize_t sfs_file_map(sfs_t *filesystem,uint64_t inode,off_t offset,size_t len,struct sfs_extent extents[],size_t max_extents);
+
+//====== orphans ======
+//puts an inode that has been removed from its directory on the orphan list (overwriting its parent_inode_pointer)
+int sfs_orphan_inode(sfs_t *filesystem,uint64_t inode);
+//frees up to max_pages of an orphan's pages, returns 1 once it has been freed completely and taken off the list, 0 if there is more
+int sfs_reclaim_inode(sfs_t *filesystem,uint64_t inode,uint64_t max_pages);
 
 //====== superblock ======
 //closing the filesystem calls this, but it wont hurt to call this occasionaly
 int sfs_update_superblock(sfs_t *filesystem);
 
 
+//====== I/O accounting ======
+//counts of physical I/O against the image charged to each operation since opening (or the last reset)
+const struct sfs_io_counters *sfs_get_io_counters(sfs_t *filesystem,enum sfs_io_op op);
+const char *sfs_io_op_name(enum sfs_io_op op);
+void sfs_reset_io_counters(sfs_t *filesystem);
+//counts one file read / write of logical_bytes done by the caller from the extents sfs_file_map gave it
+//extents the caller moved itself (e.g. libfuse splicing to and from the image fd) are passed so their I/O is counted too,
+//and left out (NULL, 0) when it went through sfs_image_read / sfs_image_write, which count their own
+void sfs_account_file_io(sfs_t *filesystem,int writing,uint64_t logical_bytes,const struct sfs_extent extents[],size_t extent_count);
+//prints a table of the counters along with physical bytes per logical byte and syscalls per call
+int sfs_print_io_report(sfs_t *filesystem,FILE *output);
+
 //====== errors and debug ======
 void sfs_perror(char *msg,int error);
 void sfs_print_info();
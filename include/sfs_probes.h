@@ -0,0 +1,25 @@
+#ifndef _SFS_PROBES_H
+#define _SFS_PROBES_H
+
+//====== USDT probes ======
+//static trace points for bpftrace / perf, e.g. bpftrace -e 'usdt:./mountsfs:sfs:page__alloc { @[arg0] = count(); }'
+//a probe that nothing is attached to is a single nop, so they stay in release builds
+//without <sys/sdt.h> (systemtap-sdt-dev) or with -DSFS_NO_PROBES they compile to nothing
+#if !defined(SFS_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define SFS_PROBES_ENABLED 1
+#endif
+#endif
+
+#ifdef SFS_PROBES_ENABLED
+#define SFS_PROBE1(name,a) DTRACE_PROBE1(sfs,name,a)
+#define SFS_PROBE2(name,a,b) DTRACE_PROBE2(sfs,name,a,b)
+#define SFS_PROBE3(name,a,b,c) DTRACE_PROBE3(sfs,name,a,b,c)
+#else
+#define SFS_PROBE1(name,a) do { (void)(a); } while (0)
+#define SFS_PROBE2(name,a,b) do { (void)(a); (void)(b); } while (0)
+#define SFS_PROBE3(name,a,b,c) do { (void)(a); (void)(b); (void)(c); } while (0)
+#endif
+
+#endif
@@ -9,15 +9,66 @@
 
 #define SFS_PAGE_SIZE 1024
 #define SFS_SUPERBLOCK_SIZE 256
+//the smallest alignment used for SFS_FUNC_FLAG_DIRECT_IO (a block device with bigger sectors gets its sector size)
+#define SFS_DIRECT_IO_ALIGNMENT 4096
+//free pages held in memory by libsfs, see sfs_allocate_page
+#define SFS_FREE_PAGE_CACHE_SIZE 128
 //uint32_t
 #define SFS_MAGIC_NO 0xC0FFEE
 
+//====== I/O accounting ======
+//the logical operations physical I/O is charged to (whichever was called first, so the header reads inside a file read count towards the read)
+enum sfs_io_op {
+	SFS_IO_OP_NONE, //I/O outside any of the below, e.g. opening the filesystem
+	SFS_IO_OP_FILE_READ,
+	SFS_IO_OP_FILE_WRITE,
+	SFS_IO_OP_FILE_GROW,
+	SFS_IO_OP_FILE_MAP,
+	SFS_IO_OP_FILE_RESIZE,
+	SFS_IO_OP_INODE_CREATE,
+	SFS_IO_OP_INODE_HEADER_READ,
+	SFS_IO_OP_INODE_HEADER_WRITE,
+	SFS_IO_OP_POINTER_GET,
+	SFS_IO_OP_POINTER_SET,
+	SFS_IO_OP_POINTER_ADD,
+	SFS_IO_OP_POINTER_REMOVE,
+	SFS_IO_OP_PAGE_ALLOCATE,
+	SFS_IO_OP_PAGE_FREE,
+	SFS_IO_OP_SUPERBLOCK_UPDATE,
+	SFS_IO_OP_INODE_RECLAIM,
+	SFS_IO_OP_INODE_MOVE,
+	SFS_IO_OP_COUNT
+};
+struct sfs_io_counters {
+	uint64_t calls;
+	uint64_t logical_bytes; //bytes the caller asked to read / write / map
+	//what was actually done to the image
+	uint64_t reads;
+	uint64_t writes;
+	uint64_t seeks;
+	uint64_t bytes_read;
+	uint64_t bytes_written;
+};
+
 //====== type to represent the filesystem as a whole ======
 struct sfs_struct {
 	uint64_t page_count;
 	int filesystem_fd;
+	int flags; //the sfs_function_flags it was opened with
 	uint64_t first_free_page_index;
 	uint64_t current_generation_number;
+	uint64_t high_water_mark; //pages from here up have never been allocated and are not on the free list
+	uint64_t orphan_list_head; //first inode unlinked but not yet reclaimed (0 for none), the rest follow through their parent_inode_pointer
+	uint64_t image_cursor; //where filesystem_fd's file offset is, kept up to date by libsfs
+	enum sfs_io_op current_io_op;
+	struct sfs_io_counters io_counters[SFS_IO_OP_COUNT];
+	//free pages that are off the on disk free list, handed out and taken back without any I/O
+	uint64_t free_page_cache[SFS_FREE_PAGE_CACHE_SIZE];
+	uint32_t free_page_cache_count;
+	//aligned bounce buffer for SFS_FUNC_FLAG_DIRECT_IO
+	uint64_t direct_alignment;
+	void *direct_buffer;
+	size_t direct_buffer_size;
 };
 typedef struct sfs_struct sfs_t;
 
@@ -37,6 +88,12 @@ struct __attribute__((__packed__)) sfs_inode {
 	char name[SFS_MAX_FILENAME_SIZE];
 };
 typedef struct sfs_inode sfs_inode_t;
+
+//====== a run of file data that is contiguous in the image ======
+struct sfs_extent {
+	uint64_t image_offset; //byte offset into the image file
+	uint64_t len;
+};
 #define SFS_INODE_ALIGNED_HEADER_SIZE (SFS_CALCULATE_ALIGNMENT_PADDING(sfs_inode_t,uint64_t)+sizeof(sfs_inode_t))
 #define SFS_INODE_MAX_POINTERS ((SFS_PAGE_SIZE-SFS_INODE_ALIGNED_HEADER_SIZE)/sizeof(uint64_t))
 
@@ -44,6 +101,10 @@ typedef struct sfs_inode sfs_inode_t;
 #define SFS_FREE_PAGE_IDENTIFIER 1
 #define SFS_DATA_PAGE_IDENTIFIER 2
 #define SFS_INODE_PAGE IDENTIFIER 3
+//the first of several free pages in a row, the free page header followed by a uint64_t run length (only written with SFS_FUNC_FLAG_PUNCH_HOLES)
+//the rest of the pages in the run are not written to (and may be holes in the image)
+#define SFS_FREE_RUN_IDENTIFIER 4
+#define SFS_FREE_RUN_HEADER_SIZE (1+sizeof(uint64_t)+sizeof(uint64_t))
 
 //====== errors ======
 #define E_MALFORMED_SUPERBLOCK -2
@@ -52,6 +113,9 @@ typedef struct sfs_inode sfs_inode_t;
 enum sfs_function_flags {
 	SFS_FUNC_FLAG_SKIP_SUPERBLOCK_CHECK  = (1<<0),
 	SFS_FUNC_FLAG_O_CREATE = (1<<1),
+	SFS_FUNC_FLAG_FALLOCATE = (1<<2), //reserve the whole image on disk up front
+	SFS_FUNC_FLAG_PUNCH_HOLES = (1<<3), //give freed pages back to the host filesystem
+	SFS_FUNC_FLAG_DIRECT_IO = (1<<4), //open the image (or block device) with O_DIRECT
 };
 
 #endif
@@ -0,0 +1,662 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <getopt.h>
+#include <dirent.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+//end to end benchmarks: makes an image, mounts it with mountsfs and runs workloads through the kernel
+//the same workloads can be run against any other directory (e.g. a tmpfs) as a baseline
+//nothing needs root, only permission to use fuse
+
+#define MAX_CLIENTS 64
+#define MOUNT_TIMEOUT_MS 5000
+
+//====== types ======
+enum workload {
+	WORKLOAD_SEQ_WRITE,
+	WORKLOAD_SEQ_READ,
+	WORKLOAD_RAND_WRITE,
+	WORKLOAD_RAND_READ,
+	WORKLOAD_CREATE,
+	WORKLOAD_STAT,
+	WORKLOAD_READDIR,
+	WORKLOAD_RENAME,
+	WORKLOAD_UNLINK,
+	WORKLOAD_COUNT
+};
+struct latencies {
+	uint64_t *samples;
+	size_t count;
+	size_t capacity;
+};
+struct client {
+	pthread_t thread;
+	int id;
+	enum workload workload;
+	char directory[PATH_MAX];
+	struct latencies latencies;
+	uint64_t bytes;
+	uint64_t start_ns;
+	uint64_t end_ns;
+	int failed;
+};
+struct config {
+	char *mountsfs_path;
+	char *mkfs_path;
+	char *sfsage_path;
+	char *age_fullness; //age the image to this percentage before mounting
+	char *image_size;
+	char *mount_options;
+	char *baseline_directory;
+	int skip_sfs;
+	int keep;
+	int json;
+	int clients;
+	size_t file_size;
+	size_t block_size;
+	size_t file_count;
+	size_t readdir_repeats;
+	int workloads[WORKLOAD_COUNT];
+};
+
+//====== prototypes ======
+static void show_usage(char *name);
+int parse_workloads(char *list);
+int parse_size(const char *string,size_t *size_return);
+uint64_t now_ns();
+int run_command(char *const argv[],const char *log_path);
+pid_t mount_sfs(const char *image_path,const char *mountpoint,const char *log_path);
+int unmount_sfs(const char *mountpoint,pid_t mountsfs_pid);
+int wait_for_mount(const char *mountpoint,pid_t mountsfs_pid);
+void run_workloads(const char *target_name,const char *directory);
+void *client_thread(void *data);
+int run_client_workload(struct client *client);
+int prepare_file(struct client *client,const char *path);
+int prepare_small_files(struct client *client);
+int latencies_add(struct latencies *latencies,uint64_t elapsed_ns);
+void report(const char *target_name,enum workload workload,struct client clients[],int client_count,uint64_t wall_ns);
+int compare_u64(const void *a,const void *b);
+
+//====== globals ======
+const char *workload_names[WORKLOAD_COUNT] = {
+	[WORKLOAD_SEQ_WRITE] = "seqwrite",
+	[WORKLOAD_SEQ_READ] = "seqread",
+	[WORKLOAD_RAND_WRITE] = "randwrite",
+	[WORKLOAD_RAND_READ] = "randread",
+	[WORKLOAD_CREATE] = "create",
+	[WORKLOAD_STAT] = "stat",
+	[WORKLOAD_READDIR] = "readdir",
+	[WORKLOAD_RENAME] = "rename",
+	[WORKLOAD_UNLINK] = "unlink",
+};
+struct config config = {
+	.mountsfs_path = "./mountsfs",
+	.mkfs_path = "./mkfs.sfs",
+	.sfsage_path = "./sfsage",
+	.age_fullness = NULL,
+	.image_size = "256M",
+	.mount_options = NULL,
+	.baseline_directory = NULL,
+	.skip_sfs = 0,
+	.keep = 0,
+	.json = 0,
+	.clients = 1,
+	.file_size = 1024*1024,
+	.block_size = 4096,
+	.file_count = 200,
+	.readdir_repeats = 20,
+};
+int results_printed = 0;
+pthread_barrier_t start_barrier;
+char *block_buffer = NULL;
+
+int main(int argc,char **argv){
+	static struct option long_options[] = {
+		{"mountsfs",	required_argument,	0,'m'},
+		{"mkfs",	required_argument,	0,'k'},
+		{"options",	required_argument,	0,'o'},
+		{"age",		required_argument,	0,'a'},
+		{"image-size",	required_argument,	0,'I'},
+		{"sfsage",	required_argument,	0,'A'},
+		{"baseline",	required_argument,	0,'B'},
+		{"baseline-only",no_argument,		0,'S'},
+		{"workloads",	required_argument,	0,'w'},
+		{"clients",	required_argument,	0,'c'},
+		{"file-size",	required_argument,	0,'s'},
+		{"block-size",	required_argument,	0,'b'},
+		{"files",	required_argument,	0,'n'},
+		{"keep",	no_argument,		0,'K'},
+		{"json",	no_argument,		0,'j'},
+		{"help",	no_argument,		0,'h'},
+		{0,		0,			0,0}
+	};
+	//everything runs by default
+	for (int i = 0; i < WORKLOAD_COUNT; i++) config.workloads[i] = 1;
+	for (;;){
+		int option_index = 0;
+		int result = getopt_long(argc,argv,"m:k:o:a:A:I:B:Sw:c:s:b:n:Kjh",long_options,&option_index);
+		if (result == -1) break;
+		switch (result){
+			case 'm': config.mountsfs_path = optarg; break;
+			case 'k': config.mkfs_path = optarg; break;
+			case 'o': config.mount_options = optarg; break;
+			case 'a': config.age_fullness = optarg; break;
+			case 'I': config.image_size = optarg; break;
+			case 'A': config.sfsage_path = optarg; break;
+			case 'B': config.baseline_directory = optarg; break;
+			case 'S': config.skip_sfs = 1; break;
+			case 'K': config.keep = 1; break;
+			case 'j': config.json = 1; break;
+			case 'w':
+				if (parse_workloads(optarg) != 0){
+					show_usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'c':
+				config.clients = atoi(optarg);
+				if (config.clients < 1 || config.clients > MAX_CLIENTS){
+					fprintf(stderr,"clients must be between 1 and %d\n",MAX_CLIENTS);
+					return 1;
+				}
+				break;
+			case 's':
+				if (parse_size(optarg,&config.file_size) != 0){
+					show_usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'b':
+				if (parse_size(optarg,&config.block_size) != 0 || config.block_size == 0){
+					show_usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'n': config.file_count = strtoull(optarg,NULL,10); break;
+			case 'h':
+				show_usage(argv[0]);
+				return 0;
+			default:
+				show_usage(argv[0]);
+				return 1;
+		}
+	}
+	if (config.skip_sfs && config.baseline_directory == NULL){
+		fprintf(stderr,"--baseline-only needs --baseline <directory>\n");
+		return 1;
+	}
+	block_buffer = malloc(config.block_size);
+	if (block_buffer == NULL) return 1;
+	memset(block_buffer,'x',config.block_size);
+	srandom(1);
+
+	if (config.json) printf("[\n");
+	else printf("target,workload,clients,ops,bytes,seconds,ops_per_sec,mib_per_sec,mean_ns,p50_ns,p99_ns,p999_ns,max_ns\n");
+	int return_val = 0;
+	//====== sfs ======
+	if (!config.skip_sfs){
+		char work_directory[] = "/tmp/sfs-e2e-XXXXXX";
+		if (mkdtemp(work_directory) == NULL){
+			perror("mkdtemp");
+			return 1;
+		}
+		char image_path[PATH_MAX], mountpoint[PATH_MAX], log_path[PATH_MAX];
+		snprintf(image_path,sizeof(image_path),"%s/image",work_directory);
+		snprintf(mountpoint,sizeof(mountpoint),"%s/mnt",work_directory);
+		snprintf(log_path,sizeof(log_path),"%s/mountsfs.log",work_directory);
+		mkdir(mountpoint,0755);
+		//make the image
+		char *mkfs_argv[] = {config.mkfs_path,"-s",config.image_size,image_path,NULL};
+		if (run_command(mkfs_argv,log_path) != 0){
+			fprintf(stderr,"%s failed, see %s\n",config.mkfs_path,log_path);
+			return 1;
+		}
+		//fragment it first if asked, the fragmentation report ends up in the log
+		if (config.age_fullness != NULL){
+			char *sfsage_argv[] = {config.sfsage_path,"-f",config.age_fullness,image_path,NULL};
+			if (run_command(sfsage_argv,log_path) != 0){
+				fprintf(stderr,"%s failed, see %s\n",config.sfsage_path,log_path);
+				return 1;
+			}
+		}
+		//mount it
+		pid_t mountsfs_pid = mount_sfs(image_path,mountpoint,log_path);
+		if (mountsfs_pid < 0 || wait_for_mount(mountpoint,mountsfs_pid) != 0){
+			fprintf(stderr,"could not mount %s, see %s\n",image_path,log_path);
+			//wait_for_mount reaps mountsfs if it died
+			if (mountsfs_pid > 0 && kill(mountsfs_pid,0) == 0) unmount_sfs(mountpoint,mountsfs_pid);
+			return 1;
+		}
+		run_workloads((config.age_fullness != NULL) ? "sfs-aged" : "sfs",mountpoint);
+		if (unmount_sfs(mountpoint,mountsfs_pid) != 0){
+			fprintf(stderr,"mountsfs did not exit cleanly, see %s\n",log_path);
+			return_val = 1;
+		}
+		if (!config.keep){
+			unlink(image_path);
+			unlink(log_path);
+			rmdir(mountpoint);
+			rmdir(work_directory);
+		}else{
+			fprintf(stderr,"kept %s\n",work_directory);
+		}
+	}
+	//====== baseline ======
+	if (config.baseline_directory != NULL){
+		char directory[PATH_MAX];
+		snprintf(directory,sizeof(directory),"%s/sfs-e2e-baseline-XXXXXX",config.baseline_directory);
+		if (mkdtemp(directory) == NULL){
+			perror("mkdtemp");
+			return 1;
+		}
+		run_workloads("baseline",directory);
+		//unlink leaves the files gone, this just tidies whatever is left
+		if (!config.keep){
+			char *rm_argv[] = {"rm","-rf",directory,NULL};
+			run_command(rm_argv,"/dev/null");
+		}
+	}
+	if (config.json) printf("\n]\n");
+	free(block_buffer);
+	return return_val;
+}
+static void show_usage(char *name){
+	printf("usage: %s [options]\n",name);
+	printf(" -m / --mountsfs <path> : mountsfs binary (default ./mountsfs)\n");
+	printf(" -k / --mkfs <path> : mkfs.sfs binary (default ./mkfs.sfs)\n");
+	printf(" -o / --options <options> : mount options passed on to mountsfs -o\n");
+	printf(" -I / --image-size <size> : size of the image passed to mkfs.sfs -s (default 256M)\n");
+	printf(" -a / --age <percent> : age the image to <percent> full with sfsage before mounting\n");
+	printf(" -A / --sfsage <path> : sfsage binary (default ./sfsage)\n");
+	printf(" -B / --baseline <directory> : also run everything in a fresh directory under <directory> (e.g. /dev/shm)\n");
+	printf(" -S / --baseline-only : skip sfs and only run the baseline\n");
+	printf(" -w / --workloads <list> : comma separated, any of");
+	for (int i = 0; i < WORKLOAD_COUNT; i++) printf(" %s",workload_names[i]);
+	printf(" (default all)\n");
+	printf(" -c / --clients <n> : clients running each workload in parallel, each in its own directory (default 1)\n");
+	printf(" -s / --file-size <size> : size of the file the read and write workloads use (default 1M)\n");
+	printf(" -b / --block-size <size> : size of each read or write (default 4K)\n");
+	printf(" -n / --files <n> : files each client creates, stats, lists, renames and unlinks (default 200)\n");
+	printf(" -K / --keep : keep the image and mountsfs log\n");
+	printf(" -j / --json : print json instead of csv\n");
+}
+int parse_workloads(char *list){
+	for (int i = 0; i < WORKLOAD_COUNT; i++) config.workloads[i] = 0;
+	for (char *name = strtok(list,","); name != NULL; name = strtok(NULL,",")){
+		int found = 0;
+		for (int i = 0; i < WORKLOAD_COUNT; i++){
+			if (strcmp(name,workload_names[i]) == 0){
+				config.workloads[i] = 1;
+				found = 1;
+			}
+		}
+		if (!found){
+			fprintf(stderr,"unknown workload %s\n",name);
+			return -1;
+		}
+	}
+	return 0;
+}
+int parse_size(const char *string,size_t *size_return){
+	char *end;
+	unsigned long long size = strtoull(string,&end,10);
+	switch (*end){
+		case 'k': case 'K': size *= 1024; end++; break;
+		case 'm': case 'M': size *= 1024*1024; end++; break;
+		case 'g': case 'G': size *= 1024*1024*1024; end++; break;
+	}
+	if (*end != '\0' || end == string) return -1;
+	*size_return = size;
+	return 0;
+}
+uint64_t now_ns(){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return (uint64_t)now.tv_sec*1000000000+now.tv_nsec;
+}
+
+//====== mounting ======
+//runs a command to completion with its output appended to log_path, returns its exit status
+int run_command(char *const argv[],const char *log_path){
+	pid_t pid = fork();
+	if (pid < 0) return -1;
+	if (pid == 0){
+		int log_fd = open(log_path,O_WRONLY | O_CREAT | O_APPEND,0644);
+		if (log_fd >= 0){
+			dup2(log_fd,STDOUT_FILENO);
+			dup2(log_fd,STDERR_FILENO);
+		}
+		execvp(argv[0],argv);
+		_exit(127);
+	}
+	int status;
+	if (waitpid(pid,&status,0) < 0) return -1;
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+//mountsfs stays in the foreground, so it is left running as a child until unmount_sfs
+pid_t mount_sfs(const char *image_path,const char *mountpoint,const char *log_path){
+	pid_t pid = fork();
+	if (pid < 0) return -1;
+	if (pid == 0){
+		int log_fd = open(log_path,O_WRONLY | O_CREAT | O_APPEND,0644);
+		if (log_fd >= 0){
+			dup2(log_fd,STDOUT_FILENO);
+			dup2(log_fd,STDERR_FILENO);
+		}
+		if (config.mount_options != NULL){
+			execl(config.mountsfs_path,config.mountsfs_path,"-o",config.mount_options,image_path,mountpoint,(char *)NULL);
+		}else{
+			execl(config.mountsfs_path,config.mountsfs_path,image_path,mountpoint,(char *)NULL);
+		}
+		_exit(127);
+	}
+	return pid;
+}
+//the mountpoint is on a different device to its parent once the mount is up
+int wait_for_mount(const char *mountpoint,pid_t mountsfs_pid){
+	char parent[PATH_MAX];
+	snprintf(parent,sizeof(parent),"%s/..",mountpoint);
+	struct stat parent_stat;
+	if (stat(parent,&parent_stat) != 0) return -1;
+	for (int waited = 0; waited < MOUNT_TIMEOUT_MS; waited += 10){
+		struct stat mount_stat;
+		if (stat(mountpoint,&mount_stat) == 0 && mount_stat.st_dev != parent_stat.st_dev) return 0;
+		//give up early if mountsfs has already died
+		if (waitpid(mountsfs_pid,NULL,WNOHANG) == mountsfs_pid) return -1;
+		usleep(10000);
+	}
+	return -1;
+}
+int unmount_sfs(const char *mountpoint,pid_t mountsfs_pid){
+	char *fusermount3_argv[] = {"fusermount3","-u",(char *)mountpoint,NULL};
+	char *fusermount_argv[] = {"fusermount","-u",(char *)mountpoint,NULL};
+	if (run_command(fusermount3_argv,"/dev/null") != 0) run_command(fusermount_argv,"/dev/null");
+	//====== give mountsfs a moment to clean up and exit ======
+	for (int waited = 0; waited < MOUNT_TIMEOUT_MS; waited += 10){
+		int status;
+		if (waitpid(mountsfs_pid,&status,WNOHANG) == mountsfs_pid){
+			return (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 0 : -1;
+		}
+		usleep(10000);
+	}
+	kill(mountsfs_pid,SIGTERM);
+	waitpid(mountsfs_pid,NULL,0);
+	return -1;
+}
+
+//====== workloads ======
+void run_workloads(const char *target_name,const char *directory){
+	struct client clients[MAX_CLIENTS];
+	memset(clients,0,sizeof(clients));
+	for (int i = 0; i < config.clients; i++){
+		clients[i].id = i;
+		snprintf(clients[i].directory,sizeof(clients[i].directory),"%s/client%d",directory,i);
+		if (mkdir(clients[i].directory,0755) != 0 && errno != EEXIST){
+			fprintf(stderr,"mkdir %s: %s\n",clients[i].directory,strerror(errno));
+			return;
+		}
+	}
+	for (int workload = 0; workload < WORKLOAD_COUNT; workload++){
+		if (!config.workloads[workload]) continue;
+		//====== start every client together ======
+		pthread_barrier_init(&start_barrier,NULL,config.clients+1);
+		for (int i = 0; i < config.clients; i++){
+			clients[i].workload = workload;
+			clients[i].latencies.count = 0;
+			clients[i].bytes = 0;
+			clients[i].failed = 0;
+			pthread_create(&clients[i].thread,NULL,client_thread,&clients[i]);
+		}
+		pthread_barrier_wait(&start_barrier);
+		for (int i = 0; i < config.clients; i++) pthread_join(clients[i].thread,NULL);
+		pthread_barrier_destroy(&start_barrier);
+		//from the first client starting to the last one finishing
+		uint64_t start = clients[0].start_ns, end = clients[0].end_ns;
+		for (int i = 1; i < config.clients; i++){
+			if (clients[i].start_ns < start) start = clients[i].start_ns;
+			if (clients[i].end_ns > end) end = clients[i].end_ns;
+		}
+		uint64_t wall_ns = end-start;
+		report(target_name,workload,clients,config.clients,wall_ns);
+	}
+	//====== tidy up ======
+	for (int i = 0; i < config.clients; i++){
+		char path[PATH_MAX+16];
+		snprintf(path,sizeof(path),"%s/data",clients[i].directory);
+		unlink(path);
+		rmdir(clients[i].directory);
+		free(clients[i].latencies.samples);
+	}
+}
+void *client_thread(void *data){
+	struct client *client = data;
+	//anything the workload depends on is set up before the barrier so it is not timed
+	char path[PATH_MAX+16];
+	snprintf(path,sizeof(path),"%s/data",client->directory);
+	int ready = 0;
+	switch (client->workload){
+		case WORKLOAD_SEQ_READ:
+		case WORKLOAD_RAND_WRITE:
+		case WORKLOAD_RAND_READ:
+			ready = prepare_file(client,path);
+			break;
+		case WORKLOAD_STAT:
+		case WORKLOAD_READDIR:
+		case WORKLOAD_RENAME:
+		case WORKLOAD_UNLINK:
+			ready = prepare_small_files(client);
+			break;
+		default:
+			break;
+	}
+	pthread_barrier_wait(&start_barrier);
+	client->start_ns = now_ns();
+	if (ready != 0 || run_client_workload(client) != 0) client->failed = 1;
+	client->end_ns = now_ns();
+	return NULL;
+}
+int run_client_workload(struct client *client){
+	char path[PATH_MAX+16];
+	snprintf(path,sizeof(path),"%s/data",client->directory);
+	size_t blocks = config.file_size/config.block_size;
+	unsigned int seed = client->id+1;
+	switch (client->workload){
+		case WORKLOAD_SEQ_WRITE:
+		case WORKLOAD_RAND_WRITE:{
+			int fd = open(path,O_WRONLY | O_CREAT,0644);
+			if (fd < 0) return -1;
+			for (size_t i = 0; i < blocks; i++){
+				size_t block = (client->workload == WORKLOAD_SEQ_WRITE) ? i : (size_t)rand_r(&seed)%blocks;
+				uint64_t start = now_ns();
+				ssize_t result = pwrite(fd,block_buffer,config.block_size,block*config.block_size);
+				latencies_add(&client->latencies,now_ns()-start);
+				if (result < 0){
+					close(fd);
+					return -1;
+				}
+				client->bytes += result;
+			}
+			return close(fd);
+		}
+		case WORKLOAD_SEQ_READ:
+		case WORKLOAD_RAND_READ:{
+			int fd = open(path,O_RDONLY);
+			if (fd < 0) return -1;
+			char *buffer = malloc(config.block_size);
+			if (buffer == NULL){
+				close(fd);
+				return -1;
+			}
+			for (size_t i = 0; i < blocks; i++){
+				size_t block = (client->workload == WORKLOAD_SEQ_READ) ? i : (size_t)rand_r(&seed)%blocks;
+				uint64_t start = now_ns();
+				ssize_t result = pread(fd,buffer,config.block_size,block*config.block_size);
+				latencies_add(&client->latencies,now_ns()-start);
+				if (result < 0){
+					free(buffer);
+					close(fd);
+					return -1;
+				}
+				client->bytes += result;
+			}
+			free(buffer);
+			return close(fd);
+		}
+		case WORKLOAD_CREATE:
+			//each file is created, given a little data and closed
+			for (size_t i = 0; i < config.file_count; i++){
+				char file_path[PATH_MAX+32];
+				snprintf(file_path,sizeof(file_path),"%s/file%zu",client->directory,i);
+				uint64_t start = now_ns();
+				int fd = open(file_path,O_WRONLY | O_CREAT | O_TRUNC,0644);
+				if (fd < 0) return -1;
+				ssize_t result = write(fd,block_buffer,(config.block_size < 100) ? config.block_size : 100);
+				close(fd);
+				latencies_add(&client->latencies,now_ns()-start);
+				if (result < 0) return -1;
+				client->bytes += result;
+			}
+			return 0;
+		case WORKLOAD_STAT:
+			for (size_t i = 0; i < config.file_count; i++){
+				char file_path[PATH_MAX+32];
+				snprintf(file_path,sizeof(file_path),"%s/file%zu",client->directory,i);
+				struct stat statbuf;
+				uint64_t start = now_ns();
+				int result = stat(file_path,&statbuf);
+				latencies_add(&client->latencies,now_ns()-start);
+				if (result != 0) return -1;
+			}
+			return 0;
+		case WORKLOAD_READDIR:
+			//each op is one full listing of the directory
+			for (size_t i = 0; i < config.readdir_repeats; i++){
+				uint64_t start = now_ns();
+				DIR *directory = opendir(client->directory);
+				if (directory == NULL) return -1;
+				for (;readdir(directory) != NULL;);
+				closedir(directory);
+				latencies_add(&client->latencies,now_ns()-start);
+			}
+			return 0;
+		case WORKLOAD_RENAME:
+			//every file is moved to a new name and then back again, so they are still there for unlink
+			for (int pass = 0; pass < 2; pass++){
+				for (size_t i = 0; i < config.file_count; i++){
+					char file_path[PATH_MAX+32];
+					char moved_path[PATH_MAX+32];
+					snprintf(file_path,sizeof(file_path),"%s/file%zu",client->directory,i);
+					snprintf(moved_path,sizeof(moved_path),"%s/moved%zu",client->directory,i);
+					uint64_t start = now_ns();
+					int result = (pass == 0) ? rename(file_path,moved_path) : rename(moved_path,file_path);
+					latencies_add(&client->latencies,now_ns()-start);
+					if (result != 0) return -1;
+				}
+			}
+			return 0;
+		case WORKLOAD_UNLINK:
+			for (size_t i = 0; i < config.file_count; i++){
+				char file_path[PATH_MAX+32];
+				snprintf(file_path,sizeof(file_path),"%s/file%zu",client->directory,i);
+				uint64_t start = now_ns();
+				int result = unlink(file_path);
+				latencies_add(&client->latencies,now_ns()-start);
+				if (result != 0) return -1;
+			}
+			return 0;
+		default:
+			return -1;
+	}
+}
+//makes sure the data file exists at full size
+int prepare_file(struct client *client,const char *path){
+	struct stat statbuf;
+	if (stat(path,&statbuf) == 0 && statbuf.st_size >= config.file_size) return 0;
+	int fd = open(path,O_WRONLY | O_CREAT,0644);
+	if (fd < 0) return -1;
+	for (size_t offset = 0; offset+config.block_size <= config.file_size; offset += config.block_size){
+		if (pwrite(fd,block_buffer,config.block_size,offset) < 0){
+			close(fd);
+			return -1;
+		}
+	}
+	return close(fd);
+}
+//makes sure all the small files exist
+int prepare_small_files(struct client *client){
+	for (size_t i = 0; i < config.file_count; i++){
+		char file_path[PATH_MAX+32];
+		snprintf(file_path,sizeof(file_path),"%s/file%zu",client->directory,i);
+		int fd = open(file_path,O_WRONLY | O_CREAT,0644);
+		if (fd < 0) return -1;
+		close(fd);
+	}
+	return 0;
+}
+
+//====== results ======
+int latencies_add(struct latencies *latencies,uint64_t elapsed_ns){
+	if (latencies->count >= latencies->capacity){
+		size_t new_capacity = (latencies->capacity == 0) ? 1024 : latencies->capacity*2;
+		uint64_t *new_samples = realloc(latencies->samples,sizeof(uint64_t)*new_capacity);
+		if (new_samples == NULL) return -1;
+		latencies->samples = new_samples;
+		latencies->capacity = new_capacity;
+	}
+	latencies->samples[latencies->count++] = elapsed_ns;
+	return 0;
+}
+int compare_u64(const void *a,const void *b){
+	uint64_t value_a = *(const uint64_t *)a;
+	uint64_t value_b = *(const uint64_t *)b;
+	return (value_a > value_b)-(value_a < value_b);
+}
+void report(const char *target_name,enum workload workload,struct client clients[],int client_count,uint64_t wall_ns){
+	//====== merge every client ======
+	size_t count = 0;
+	uint64_t bytes = 0;
+	for (int i = 0; i < client_count; i++){
+		if (clients[i].failed) fprintf(stderr,"%s: %s failed for client %d: %s\n",target_name,workload_names[workload],i,strerror(errno));
+		count += clients[i].latencies.count;
+		bytes += clients[i].bytes;
+	}
+	if (count == 0) return;
+	uint64_t *samples = malloc(sizeof(uint64_t)*count);
+	if (samples == NULL) return;
+	size_t filled = 0;
+	uint64_t total_ns = 0;
+	for (int i = 0; i < client_count; i++){
+		memcpy(samples+filled,clients[i].latencies.samples,sizeof(uint64_t)*clients[i].latencies.count);
+		filled += clients[i].latencies.count;
+	}
+	for (size_t i = 0; i < count; i++) total_ns += samples[i];
+	qsort(samples,count,sizeof(uint64_t),compare_u64);
+	//====== throughput is over the wall clock time of the whole workload ======
+	double seconds = wall_ns/1e9;
+	double ops_per_sec = count/seconds;
+	double mib_per_sec = bytes/seconds/(1024*1024);
+	uint64_t mean = total_ns/count;
+	uint64_t p50 = samples[count*500/1000];
+	uint64_t p99 = samples[count*990/1000];
+	uint64_t p999 = samples[count*999/1000];
+	uint64_t max = samples[count-1];
+	if (config.json){
+		printf("%s  {\"target\": \"%s\", \"workload\": \"%s\", \"clients\": %d, \"ops\": %zu, \"bytes\": %lu, \"seconds\": %.6f, \"ops_per_sec\": %.0f, \"mib_per_sec\": %.2f, \"mean_ns\": %lu, \"p50_ns\": %lu, \"p99_ns\": %lu, \"p999_ns\": %lu, \"max_ns\": %lu}",
+			results_printed ? ",\n" : "",target_name,workload_names[workload],client_count,count,bytes,seconds,ops_per_sec,mib_per_sec,mean,p50,p99,p999,max);
+	}else{
+		printf("%s,%s,%d,%zu,%lu,%.6f,%.0f,%.2f,%lu,%lu,%lu,%lu,%lu\n",target_name,workload_names[workload],client_count,count,bytes,seconds,ops_per_sec,mib_per_sec,mean,p50,p99,p999,max);
+	}
+	results_printed++;
+	fflush(stdout);
+	free(samples);
+}
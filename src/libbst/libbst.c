@@ -37,6 +37,14 @@ static struct bst_node *_inorder_successor(struct bst_node *node){
 	return current_node;
 }
 
+//puts child (which may be NULL) where node was under node's parent
+static void _replace_in_parent(BST *bst,struct bst_node *node,struct bst_node *child){
+	if (child != NULL) child->parent = node->parent;
+	if (node->parent == NULL) bst->root = child;
+	else if (node->parent->left == node) node->parent->left = child;
+	else node->parent->right = child;
+}
+
 //====== exported functions ======
 
 BST *bst_new(struct bst_user_functions *user_functions){
@@ -107,45 +115,20 @@ void bst_print_nodes_inorder(BST *bst){
 	_recursive_print_inorder(bst,bst->root);
 }
 int bst_delete_node(BST *bst,struct bst_node *node){
+	bst->user_functions->free_data(node->data);
 	//====== two children ======
 	if ((node->left != NULL) && (node->right != NULL)){
-		//find the inorder sucsessor
-		struct bst_node *successor = _inorder_successor(node);	
-		//sever the successor from its parent
-		if (successor->parent->left == successor) successor->parent->left = NULL;
-		if (successor->parent->right == successor) successor->parent->right = NULL;
-		//replace the data and pointers
-		bst->user_functions->free_data(node->data);
-		node->data = successor->data;
-		if (successor->right != NULL){
-			node->right = successor->right;
-			node->right->parent = node;
-		}
-		//free the successor
-		free(successor);
-	}
-	//====== one child ======
-	else if ((node->left != NULL) || (node->right != NULL)){
-		//find the successor
-		struct bst_node *successor;
-		if (node->left != NULL) successor = node->left;
-		if (node->right != NULL) successor = node->right;
-		//replace this node's data with the successor's data
-		bst->user_functions->free_data(node->data);
+		//take the inorder successor's data, then unlink the successor (it never has a left child)
+		struct bst_node *successor = _inorder_successor(node);
 		node->data = successor->data;
-		node->left = successor->left;
-		node->right = successor->right;
-		//delete the successor
+		_replace_in_parent(bst,successor,successor->right);
 		free(successor);
 	}
-	//====== zero children ======
-	else if ((node->left == NULL) && (node->right == NULL)){
-		//remove its pointer from the parent
-		if (node->parent == NULL); //do nothing if it is the root node
-		else if (node->parent->left == node) node->parent->left = NULL;
-		else if (node->parent->right == node) node->parent->left = NULL;
-		//free the data
-		bst->user_functions->free_data(node->data);
+	//====== one or zero children ======
+	else{
+		//the child (if any) takes this node's place
+		struct bst_node *child = (node->left != NULL) ? node->left : node->right;
+		_replace_in_parent(bst,node,child);
 		free(node);
 	}
 	return 0;
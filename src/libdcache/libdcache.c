@@ -0,0 +1,151 @@
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include "libdcache.h"
+
+//====== static functions ======
+//fnv-1a over the parent and then the name
+static uint32_t _dcache_hash(uint64_t parent,const char *name){
+	uint32_t hash = 2166136261u;
+	for (int i = 0; i < 8; i++){
+		hash ^= (parent >> (i*8)) & 0xff;
+		hash *= 16777619u;
+	}
+	for (;*name != '\0'; name++){
+		hash ^= (unsigned char)*name;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+static struct dcache_entry **_dcache_find(DCACHE *dcache,uint64_t parent,const char *name,uint32_t hash){
+	struct dcache_entry **link = &dcache->buckets[hash & dcache->bucket_mask];
+	for (;*link != NULL; link = &(*link)->hash_next){
+		struct dcache_entry *entry = *link;
+		if (entry->hash == hash && entry->parent == parent && strcmp(entry->name,name) == 0) return link;
+	}
+	return link;
+}
+static void _dcache_lru_unlink(DCACHE *dcache,struct dcache_entry *entry){
+	if (entry->lru_prev != NULL) entry->lru_prev->lru_next = entry->lru_next;
+	else dcache->lru_head = entry->lru_next;
+	if (entry->lru_next != NULL) entry->lru_next->lru_prev = entry->lru_prev;
+	else dcache->lru_tail = entry->lru_prev;
+}
+static void _dcache_lru_push(DCACHE *dcache,struct dcache_entry *entry){
+	entry->lru_prev = NULL;
+	entry->lru_next = dcache->lru_head;
+	if (dcache->lru_head != NULL) dcache->lru_head->lru_prev = entry;
+	dcache->lru_head = entry;
+	if (dcache->lru_tail == NULL) dcache->lru_tail = entry;
+}
+//takes an entry out of its bucket and the lru list, without freeing it
+static void _dcache_unlink(DCACHE *dcache,struct dcache_entry *entry){
+	struct dcache_entry **link = &dcache->buckets[entry->hash & dcache->bucket_mask];
+	for (;*link != entry; link = &(*link)->hash_next);
+	*link = entry->hash_next;
+	_dcache_lru_unlink(dcache,entry);
+	dcache->entry_count--;
+}
+
+//====== exported functions ======
+DCACHE *dcache_new(size_t max_entries){
+	DCACHE *dcache = malloc(sizeof(DCACHE));
+	if (dcache == NULL) return NULL;
+	memset(dcache,0,sizeof(DCACHE));
+	dcache->max_entries = max_entries;
+	//about one entry per bucket when full
+	size_t bucket_count = 1;
+	for (;bucket_count < max_entries; bucket_count *= 2);
+	dcache->bucket_mask = bucket_count-1;
+	dcache->buckets = calloc(bucket_count,sizeof(struct dcache_entry *));
+	if (dcache->buckets == NULL){
+		free(dcache);
+		return NULL;
+	}
+	return dcache;
+}
+void dcache_delete(DCACHE *dcache){
+	for (struct dcache_entry *entry = dcache->lru_head; entry != NULL;){
+		struct dcache_entry *next = entry->lru_next;
+		free(entry);
+		entry = next;
+	}
+	free(dcache->buckets);
+	free(dcache);
+}
+int dcache_lookup(DCACHE *dcache,uint64_t parent,const char *name,uint64_t *inode_return){
+	struct dcache_entry *entry = *_dcache_find(dcache,parent,name,_dcache_hash(parent,name));
+	if (entry == NULL){
+		dcache->stats.misses++;
+		return 0;
+	}
+	if (entry->inode == DCACHE_NEGATIVE) dcache->stats.negative_hits++;
+	else dcache->stats.hits++;
+	//most recently used
+	_dcache_lru_unlink(dcache,entry);
+	_dcache_lru_push(dcache,entry);
+	*inode_return = entry->inode;
+	return 1;
+}
+int dcache_insert(DCACHE *dcache,uint64_t parent,const char *name,uint64_t inode){
+	uint32_t hash = _dcache_hash(parent,name);
+	struct dcache_entry *entry = *_dcache_find(dcache,parent,name,hash);
+	//====== already there, just update it ======
+	if (entry != NULL){
+		entry->inode = inode;
+		_dcache_lru_unlink(dcache,entry);
+		_dcache_lru_push(dcache,entry);
+		return 0;
+	}
+	if (dcache->max_entries == 0) return 0;
+	//====== reuse the least recently used entry when full ======
+	size_t name_size = strlen(name)+1;
+	if (dcache->entry_count >= dcache->max_entries){
+		entry = dcache->lru_tail;
+		_dcache_unlink(dcache,entry);
+		dcache->stats.evictions++;
+		if (entry->name_size < name_size){
+			struct dcache_entry *bigger_entry = realloc(entry,sizeof(struct dcache_entry)+name_size);
+			if (bigger_entry == NULL){
+				free(entry);
+				return -1;
+			}
+			entry = bigger_entry;
+			entry->name_size = name_size;
+		}
+	}else{
+		entry = malloc(sizeof(struct dcache_entry)+name_size);
+		if (entry == NULL) return -1;
+		entry->name_size = name_size;
+	}
+	//====== fill it in ======
+	entry->parent = parent;
+	entry->inode = inode;
+	entry->hash = hash;
+	memcpy(entry->name,name,name_size);
+	struct dcache_entry **bucket = &dcache->buckets[hash & dcache->bucket_mask];
+	entry->hash_next = *bucket;
+	*bucket = entry;
+	_dcache_lru_push(dcache,entry);
+	dcache->entry_count++;
+	return 0;
+}
+void dcache_remove(DCACHE *dcache,uint64_t parent,const char *name){
+	struct dcache_entry *entry = *_dcache_find(dcache,parent,name,_dcache_hash(parent,name));
+	if (entry == NULL) return;
+	_dcache_unlink(dcache,entry);
+	free(entry);
+}
+void dcache_remove_parent(DCACHE *dcache,uint64_t parent){
+	for (struct dcache_entry *entry = dcache->lru_head; entry != NULL;){
+		struct dcache_entry *next = entry->lru_next;
+		if (entry->parent == parent){
+			_dcache_unlink(dcache,entry);
+			free(entry);
+		}
+		entry = next;
+	}
+}
+const struct dcache_stats *dcache_get_stats(DCACHE *dcache){
+	return &dcache->stats;
+}
@@ -0,0 +1,53 @@
+#ifndef _LIBDCACHE_H
+#define _LIBDCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//what a name is cached as when it is known not to exist in its parent
+#define DCACHE_NEGATIVE ((uint64_t)-1)
+
+//====== types ======
+struct dcache_entry {
+	struct dcache_entry *hash_next; //the rest of its bucket
+	//least recently used order, most recent at the head
+	struct dcache_entry *lru_prev;
+	struct dcache_entry *lru_next;
+	uint64_t parent;
+	uint64_t inode; //or DCACHE_NEGATIVE
+	uint32_t hash;
+	uint32_t name_size; //room for the name, which can be more than it needs after the entry is reused
+	char name[];
+};
+struct dcache_stats {
+	uint64_t hits;
+	uint64_t negative_hits;
+	uint64_t misses;
+	uint64_t evictions;
+};
+struct dcache {
+	size_t max_entries;
+	size_t entry_count;
+	size_t bucket_mask; //bucket count-1, a power of 2
+	struct dcache_entry **buckets;
+	struct dcache_entry *lru_head;
+	struct dcache_entry *lru_tail;
+	struct dcache_stats stats;
+};
+typedef struct dcache DCACHE;
+
+//====== functions ======
+//max_entries of 0 gives a cache that never holds anything
+DCACHE *dcache_new(size_t max_entries);
+void dcache_delete(DCACHE *dcache);
+//1 and the inode (maybe DCACHE_NEGATIVE) if the name is cached, 0 if it has to be looked up
+int dcache_lookup(DCACHE *dcache,uint64_t parent,const char *name,uint64_t *inode_return);
+//adds or replaces an entry, pushing out the least recently used one when full
+//an existing entry is always replaced, so a failure (ENOMEM) never leaves a stale one behind
+int dcache_insert(DCACHE *dcache,uint64_t parent,const char *name,uint64_t inode);
+void dcache_remove(DCACHE *dcache,uint64_t parent,const char *name);
+//drops every entry under parent (e.g. once it is deleted, as its inode number can be reused)
+void dcache_remove_parent(DCACHE *dcache,uint64_t parent);
+const struct dcache_stats *dcache_get_stats(DCACHE *dcache);
+
+#endif
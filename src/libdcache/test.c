@@ -0,0 +1,38 @@
+#include <stdio.h>
+#include <assert.h>
+#include <stdint.h>
+#include "libdcache.h"
+
+int main(){
+	DCACHE *dcache = dcache_new(4);
+	uint64_t inode;
+	assert(dcache_lookup(dcache,1,"a",&inode) == 0);
+	assert(dcache_insert(dcache,1,"a",10) == 0);
+	assert(dcache_insert(dcache,1,"b",DCACHE_NEGATIVE) == 0);
+	assert(dcache_insert(dcache,2,"a",20) == 0);
+	assert(dcache_lookup(dcache,1,"a",&inode) == 1 && inode == 10);
+	assert(dcache_lookup(dcache,1,"b",&inode) == 1 && inode == DCACHE_NEGATIVE);
+	assert(dcache_lookup(dcache,2,"a",&inode) == 1 && inode == 20);
+	//a created file replaces its negative entry
+	assert(dcache_insert(dcache,1,"b",11) == 0);
+	assert(dcache_lookup(dcache,1,"b",&inode) == 1 && inode == 11);
+	//full, so the least recently used (1/a) goes, and its entry is reused for the longer name
+	assert(dcache_insert(dcache,3,"x",30) == 0);
+	assert(dcache_insert(dcache,3,"a much longer name than before",31) == 0);
+	assert(dcache_lookup(dcache,1,"a",&inode) == 0);
+	assert(dcache_lookup(dcache,3,"a much longer name than before",&inode) == 1 && inode == 31);
+	dcache_remove(dcache,3,"x");
+	assert(dcache_lookup(dcache,3,"x",&inode) == 0);
+	dcache_remove_parent(dcache,3);
+	assert(dcache_lookup(dcache,3,"a much longer name than before",&inode) == 0);
+	assert(dcache_lookup(dcache,1,"b",&inode) == 1);
+	const struct dcache_stats *stats = dcache_get_stats(dcache);
+	printf("%lu hits, %lu negative hits, %lu misses, %lu evictions\n",stats->hits,stats->negative_hits,stats->misses,stats->evictions);
+	assert(stats->evictions == 1);
+	dcache_delete(dcache);
+	//caches nothing
+	dcache = dcache_new(0);
+	assert(dcache_insert(dcache,1,"a",10) == 0);
+	assert(dcache_lookup(dcache,1,"a",&inode) == 0);
+	dcache_delete(dcache);
+}
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include "liblog.h"
+
+//====== types ======
+struct log_slot {
+	//slot is free for the writer at position n when sequence == n, and ready for the reader when sequence == n+1
+	atomic_size_t sequence;
+	int level;
+	struct timespec time;
+	char message[LOG_MESSAGE_SIZE];
+};
+
+//====== globals ======
+int log_runtime_level = LOG_LEVEL_INFO;
+static struct log_slot log_ring[LOG_RING_SIZE];
+static atomic_size_t enqueue_position;
+static size_t dequeue_position; //only touched by the background thread
+static atomic_ulong dropped_messages;
+static atomic_int running;
+static pthread_t log_thread;
+static FILE *log_output;
+
+static const char *level_names[] = {
+	[LOG_LEVEL_NONE] = "none",
+	[LOG_LEVEL_ERROR] = "error",
+	[LOG_LEVEL_WARN] = "warn",
+	[LOG_LEVEL_INFO] = "info",
+	[LOG_LEVEL_DEBUG] = "debug",
+};
+
+//====== static functions ======
+static void _write_message(FILE *output,int level,struct timespec *time,const char *message){
+	struct tm broken_down_time;
+	localtime_r(&time->tv_sec,&broken_down_time);
+	char time_string[32];
+	strftime(time_string,sizeof(time_string),"%H:%M:%S",&broken_down_time);
+	fprintf(output,"%s.%06ld [%s] %s\n",time_string,time->tv_nsec/1000,level_names[level],message);
+}
+//returns 1 if a message was written, 0 if the ring is empty
+static int _drain_one(){
+	struct log_slot *slot = &log_ring[dequeue_position & (LOG_RING_SIZE-1)];
+	size_t sequence = atomic_load_explicit(&slot->sequence,memory_order_acquire);
+	if (sequence != dequeue_position+1) return 0;
+	_write_message(log_output,slot->level,&slot->time,slot->message);
+	//hand the slot back to writers for the next lap of the ring
+	atomic_store_explicit(&slot->sequence,dequeue_position+LOG_RING_SIZE,memory_order_release);
+	dequeue_position++;
+	return 1;
+}
+static void *_log_thread(void *){
+	for (;;){
+		int wrote_any = 0;
+		for (;_drain_one();) wrote_any = 1;
+		if (wrote_any) fflush(log_output);
+		else if (!atomic_load(&running)) break;
+		else{
+			//nothing to do, check back shortly
+			struct timespec wait = {.tv_sec = 0,.tv_nsec = 1000000};
+			nanosleep(&wait,NULL);
+		}
+	}
+	return NULL;
+}
+
+//====== exported functions ======
+int log_start(FILE *output){
+	log_output = output;
+	for (size_t i = 0; i < LOG_RING_SIZE; i++){
+		atomic_init(&log_ring[i].sequence,i);
+	}
+	atomic_store(&enqueue_position,0);
+	dequeue_position = 0;
+	atomic_store(&running,1);
+	if (pthread_create(&log_thread,NULL,_log_thread,NULL) != 0){
+		atomic_store(&running,0);
+		return -1;
+	}
+	return 0;
+}
+void log_stop(){
+	if (!atomic_load(&running)) return;
+	atomic_store(&running,0);
+	pthread_join(log_thread,NULL);
+	if (atomic_load(&dropped_messages) > 0){
+		fprintf(log_output,"%lu log messages were dropped\n",atomic_load(&dropped_messages));
+	}
+	fflush(log_output);
+}
+void log_set_level(int level){
+	log_runtime_level = level;
+}
+int log_parse_level(const char *name){
+	for (int i = 0; i < sizeof(level_names)/sizeof(level_names[0]); i++){
+		if (strcmp(level_names[i],name) == 0) return i;
+	}
+	return -1;
+}
+void log_message(int level,const char *format,...){
+	va_list args;
+	va_start(args,format);
+	struct timespec time;
+	clock_gettime(CLOCK_REALTIME,&time);
+	if (!atomic_load_explicit(&running,memory_order_relaxed)){
+		//no background thread, just write it now
+		char message[LOG_MESSAGE_SIZE];
+		vsnprintf(message,sizeof(message),format,args);
+		va_end(args);
+		_write_message(stderr,level,&time,message);
+		return;
+	}
+	//====== claim a slot ======
+	size_t position = atomic_load_explicit(&enqueue_position,memory_order_relaxed);
+	struct log_slot *slot;
+	for (;;){
+		slot = &log_ring[position & (LOG_RING_SIZE-1)];
+		size_t sequence = atomic_load_explicit(&slot->sequence,memory_order_acquire);
+		intptr_t difference = (intptr_t)sequence-(intptr_t)position;
+		if (difference == 0){
+			//free, try to take it (position is updated for us if someone else got there first)
+			if (atomic_compare_exchange_weak_explicit(&enqueue_position,&position,position+1,memory_order_relaxed,memory_order_relaxed)) break;
+		}else if (difference < 0){
+			//the reader hasnt got this far yet, the ring is full
+			atomic_fetch_add_explicit(&dropped_messages,1,memory_order_relaxed);
+			va_end(args);
+			return;
+		}else{
+			position = atomic_load_explicit(&enqueue_position,memory_order_relaxed);
+		}
+	}
+	//====== fill it in and publish it ======
+	slot->level = level;
+	slot->time = time;
+	vsnprintf(slot->message,LOG_MESSAGE_SIZE,format,args);
+	va_end(args);
+	atomic_store_explicit(&slot->sequence,position+1,memory_order_release);
+}
+unsigned long log_dropped_count(){
+	return atomic_load(&dropped_messages);
+}
@@ -0,0 +1,45 @@
+#ifndef _LIBLOG_H
+#define _LIBLOG_H
+
+#include <stdio.h>
+
+//====== levels ======
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+//messages above this level are compiled out completely (override with -DLOG_COMPILE_LEVEL=...)
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+//====== ring buffer ======
+#define LOG_RING_SIZE 4096 //must be a power of 2
+#define LOG_MESSAGE_SIZE 256 //longer messages are truncated
+
+//====== macros ======
+extern int log_runtime_level;
+//the level is checked before the arguments are evaluated, so disabled messages cost a compare at most
+#define LOG_ENABLED(level) ((level) <= LOG_COMPILE_LEVEL && (level) <= log_runtime_level)
+#define LOG(level,...) do { if (LOG_ENABLED(level)) log_message((level),__VA_ARGS__); } while (0)
+#define LOG_ERROR(...) LOG(LOG_LEVEL_ERROR,__VA_ARGS__)
+#define LOG_WARN(...) LOG(LOG_LEVEL_WARN,__VA_ARGS__)
+#define LOG_INFO(...) LOG(LOG_LEVEL_INFO,__VA_ARGS__)
+#define LOG_DEBUG(...) LOG(LOG_LEVEL_DEBUG,__VA_ARGS__)
+
+//====== functions ======
+//starts the background thread that writes queued messages to output
+//until then (and after log_stop) messages are written straight to stderr
+int log_start(FILE *output);
+//writes out everything still queued then stops the background thread
+void log_stop();
+void log_set_level(int level);
+//turns "error", "warn", "info" or "debug" into a level, -1 if unknown
+int log_parse_level(const char *name);
+//never blocks, if the ring is full the message is dropped and counted
+void log_message(int level,const char *format,...) __attribute__((format(printf,2,3)));
+unsigned long log_dropped_count();
+
+#endif
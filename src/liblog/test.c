@@ -0,0 +1,29 @@
+#include <stdio.h>
+#include <pthread.h>
+#include "liblog.h"
+
+void *spam(void *data){
+	int thread = *(int *)data;
+	for (int i = 0; i < 1000; i++){
+		LOG_INFO("thread %d message %d",thread,i);
+		LOG_DEBUG("this should not be seen");
+	}
+	return NULL;
+}
+int main(){
+	LOG_INFO("written straight away as the logger hasnt started");
+	log_start(stdout);
+	pthread_t threads[4];
+	int ids[4];
+	for (int i = 0; i < 4; i++){
+		ids[i] = i;
+		pthread_create(&threads[i],NULL,spam,&ids[i]);
+	}
+	for (int i = 0; i < 4; i++){
+		pthread_join(threads[i],NULL);
+	}
+	log_set_level(log_parse_level("debug"));
+	LOG_DEBUG("debug enabled");
+	log_stop();
+	printf("dropped %lu\n",log_dropped_count());
+}
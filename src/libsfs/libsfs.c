@@ -1,7 +1,11 @@
 #define _LARGEFILE64_SOURCE
+#define _GNU_SOURCE
 
 #include "../../include/sfs_functions.h"
 #include "../../include/sfs_types.h"
+#include "../liblog/liblog.h"
+#include "../libstats/libstats.h"
+#include "../../include/sfs_probes.h"
 
 #include <sys/types.h>
 #include <unistd.h>
@@ -13,8 +17,11 @@
 #include <string.h>
 #include <fcntl.h>
 #include <endian.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
 
-#define PERROR(str) (fprintf(stderr,"[%s:%d] %s in %s: %s\n",__FILE_NAME__,__LINE__,str,__FUNCTION__,strerror(errno)))
+#define PERROR(str) LOG_ERROR("[%s:%d] %s in %s: %s",__FILE_NAME__,__LINE__,str,__FUNCTION__,strerror(errno))
 #define MIN(a,b) (((a) < (b)) ? (a) : (b))
 #define MAX(a,b) (((a) > (b)) ? (a) : (b))
 
@@ -33,22 +40,223 @@ const char *sfs_errno_to_str(int result){
 void sfs_PERROR(char *msg,int error){
 	fprintf(stderr,"%s: %s\n",msg,sfs_errno_to_str(error));
 }
-int writeall(int fd, const void *buffer, size_t len, uint64_t offset){
-	for (int i = 0; i < len;){
-		int result = pwrite(fd,buffer+i,len-i,offset);
+//====== operations ======
+//goes at the top of every exported operation: times it into the stats and charges any I/O done until it returns to it
+//(unless it was called from inside another operation, which keeps the charge)
+struct io_scope {
+	sfs_t *filesystem;
+	int outermost;
+	enum sfs_io_op previous_op;
+};
+static inline struct io_scope io_scope_begin(sfs_t *filesystem,enum sfs_io_op op){
+	struct io_scope scope = {.filesystem = filesystem,.outermost = 0,.previous_op = filesystem->current_io_op};
+	if (filesystem->current_io_op == SFS_IO_OP_NONE){
+		scope.outermost = 1;
+		filesystem->current_io_op = op;
+		filesystem->io_counters[op].calls++;
+	}
+	return scope;
+}
+static inline void io_scope_end(struct io_scope *scope){
+	scope->filesystem->current_io_op = scope->previous_op;
+}
+#define OPERATION(filesystem,op,name) \
+	STATS_SCOPE(name); \
+	struct io_scope _io_scope __attribute__((cleanup(io_scope_end))) = io_scope_begin((filesystem),(op))
+//logical bytes moved by the operation
+#define OPERATION_BYTES(count) do { \
+	STATS_BYTES(count); \
+	if (_io_scope.outermost) _io_scope.filesystem->io_counters[_io_scope.filesystem->current_io_op].logical_bytes += (count); \
+} while (0)
+
+static const char *io_op_names[SFS_IO_OP_COUNT] = {
+	[SFS_IO_OP_NONE] = "other",
+	[SFS_IO_OP_FILE_READ] = "file_read",
+	[SFS_IO_OP_FILE_WRITE] = "file_write",
+	[SFS_IO_OP_FILE_GROW] = "file_grow_for_write",
+	[SFS_IO_OP_FILE_MAP] = "file_map",
+	[SFS_IO_OP_FILE_RESIZE] = "file_resize",
+	[SFS_IO_OP_INODE_CREATE] = "inode_create",
+	[SFS_IO_OP_INODE_HEADER_READ] = "inode_header_read",
+	[SFS_IO_OP_INODE_HEADER_WRITE] = "inode_header_write",
+	[SFS_IO_OP_POINTER_GET] = "pointer_get",
+	[SFS_IO_OP_POINTER_SET] = "pointer_set",
+	[SFS_IO_OP_POINTER_ADD] = "pointer_add",
+	[SFS_IO_OP_POINTER_REMOVE] = "pointer_remove",
+	[SFS_IO_OP_PAGE_ALLOCATE] = "page_allocate",
+	[SFS_IO_OP_PAGE_FREE] = "page_free",
+	[SFS_IO_OP_SUPERBLOCK_UPDATE] = "superblock_update",
+	[SFS_IO_OP_INODE_RECLAIM] = "inode_reclaim",
+	[SFS_IO_OP_INODE_MOVE] = "inode_move",
+};
+
+//====== O_DIRECT ======
+//with SFS_FUNC_FLAG_DIRECT_IO every transfer has to start, end and land in memory on a multiple of the alignment,
+//so reads and writes are widened to whole blocks and go through a bounce buffer that is kept between calls
+static void *direct_buffer_reserve(sfs_t *filesystem,size_t len){
+	if (len <= filesystem->direct_buffer_size) return filesystem->direct_buffer;
+	void *buffer;
+	errno = posix_memalign(&buffer,filesystem->direct_alignment,len);
+	if (errno != 0) return NULL;
+	free(filesystem->direct_buffer);
+	filesystem->direct_buffer = buffer;
+	filesystem->direct_buffer_size = len;
+	return buffer;
+}
+//reads whole blocks, anything past the end of the image reads as 0s. returns the bytes that were really there
+static ssize_t direct_read_blocks(sfs_t *filesystem,char *buffer,size_t len,uint64_t offset){
+	size_t done = 0;
+	while (done < len){
+		SFS_PROBE2(image__read,offset+done,len-done);
+		ssize_t result = pread(filesystem->filesystem_fd,buffer+done,len-done,offset+done);
+		filesystem->io_counters[filesystem->current_io_op].reads++;
+		if (result < 0){
+			PERROR("pread");
+			return -1;
+		}
+		if (result == 0) break;
+		filesystem->io_counters[filesystem->current_io_op].bytes_read += result;
+		done += result;
+	}
+	memset(buffer+done,0,len-done);
+	return done;
+}
+static int direct_transfer(sfs_t *filesystem,void *buffer,size_t len,uint64_t offset,int writing){
+	uint64_t alignment = filesystem->direct_alignment;
+	uint64_t start = offset & ~(alignment-1);
+	uint64_t end = (offset+len+alignment-1) & ~(alignment-1);
+	char *bounce = direct_buffer_reserve(filesystem,end-start);
+	if (bounce == NULL) return -1;
+	if (!writing){
+		ssize_t result = direct_read_blocks(filesystem,bounce,end-start,start);
+		if (result < 0) return -1;
+		if (start+result < offset+len){
+			//past the end of the image
+			errno = EIO;
+			return -1;
+		}
+		memcpy(buffer,bounce+(offset-start),len);
+		return 0;
+	}
+	//====== read in the blocks the write only covers part of ======
+	if (start != offset && direct_read_blocks(filesystem,bounce,alignment,start) < 0) return -1;
+	if (end != offset+len && (end-alignment != start || start == offset)){
+		if (direct_read_blocks(filesystem,bounce+(end-alignment-start),alignment,end-alignment) < 0) return -1;
+	}
+	memcpy(bounce+(offset-start),buffer,len);
+	for (size_t done = 0; done < end-start;){
+		SFS_PROBE2(image__write,start+done,end-start-done);
+		ssize_t result = pwrite(filesystem->filesystem_fd,bounce+done,end-start-done,start+done);
+		filesystem->io_counters[filesystem->current_io_op].writes++;
+		if (result < 0){
+			PERROR("pwrite");
+			return -1;
+		}
+		filesystem->io_counters[filesystem->current_io_op].bytes_written += result;
+		done += result;
+	}
+	return 0;
+}
+static int image_is_block_device(sfs_t *filesystem){
+	struct stat statbuf;
+	return (fstat(filesystem->filesystem_fd,&statbuf) == 0 && S_ISBLK(statbuf.st_mode));
+}
+//size of the file or device holding the image in bytes
+static int image_capacity(sfs_t *filesystem,uint64_t *capacity_return){
+	struct stat statbuf;
+	if (fstat(filesystem->filesystem_fd,&statbuf) != 0) return -1;
+	if (!S_ISBLK(statbuf.st_mode)){
+		*capacity_return = statbuf.st_size;
+		return 0;
+	}
+	return ioctl(filesystem->filesystem_fd,BLKGETSIZE64,capacity_return);
+}
+static void close_image(sfs_t *filesystem){
+	close(filesystem->filesystem_fd);
+	free(filesystem->direct_buffer);
+	filesystem->direct_buffer = NULL;
+	filesystem->direct_buffer_size = 0;
+}
+
+//====== image I/O ======
+//every access to the image goes through these, so each physical read, write and seek has one place to be traced
+//the cursor is tracked alongside the fd so reads and writes at the cursor can report their offset
+static off_t image_seek(sfs_t *filesystem,off_t offset,int whence){
+	off_t result;
+	if ((filesystem->flags & SFS_FUNC_FLAG_DIRECT_IO) && whence != SEEK_END){
+		//reads and writes at the cursor are positioned ones, so the fd offset is never used
+		result = (whence == SEEK_SET) ? offset : (off_t)filesystem->image_cursor+offset;
+	}else{
+		result = lseek(filesystem->filesystem_fd,offset,whence);
+	}
+	filesystem->io_counters[filesystem->current_io_op].seeks++;
+	if (result != (off_t)-1) filesystem->image_cursor = result;
+	SFS_PROBE2(image__seek,(int64_t)result,whence);
+	return result;
+}
+static ssize_t image_read(sfs_t *filesystem,void *buffer,size_t len){
+	if (filesystem->flags & SFS_FUNC_FLAG_DIRECT_IO){
+		if (direct_transfer(filesystem,buffer,len,filesystem->image_cursor,0) != 0) return -1;
+		filesystem->image_cursor += len;
+		return len;
+	}
+	SFS_PROBE2(image__read,filesystem->image_cursor,len);
+	ssize_t result = read(filesystem->filesystem_fd,buffer,len);
+	filesystem->io_counters[filesystem->current_io_op].reads++;
+	if (result > 0){
+		filesystem->image_cursor += result;
+		filesystem->io_counters[filesystem->current_io_op].bytes_read += result;
+	}
+	return result;
+}
+static ssize_t image_write(sfs_t *filesystem,const void *buffer,size_t len){
+	if (filesystem->flags & SFS_FUNC_FLAG_DIRECT_IO){
+		if (direct_transfer(filesystem,(void *)buffer,len,filesystem->image_cursor,1) != 0) return -1;
+		filesystem->image_cursor += len;
+		return len;
+	}
+	SFS_PROBE2(image__write,filesystem->image_cursor,len);
+	ssize_t result = write(filesystem->filesystem_fd,buffer,len);
+	filesystem->io_counters[filesystem->current_io_op].writes++;
+	if (result > 0){
+		filesystem->image_cursor += result;
+		filesystem->io_counters[filesystem->current_io_op].bytes_written += result;
+	}
+	return result;
+}
+int writeall(sfs_t *filesystem, const void *buffer, size_t len, uint64_t offset){
+	if (filesystem->flags & SFS_FUNC_FLAG_DIRECT_IO){
+		return (direct_transfer(filesystem,(void *)buffer,len,offset,1) == 0) ? (int)len : -1;
+	}
+	for (size_t i = 0; i < len;){
+		SFS_PROBE2(image__write,offset+i,len-i);
+		ssize_t result = pwrite(filesystem->filesystem_fd,buffer+i,len-i,offset+i);
+		filesystem->io_counters[filesystem->current_io_op].writes++;
 		if (result < 0){
 			PERROR("pwrite");
 			return -1;
 		}
+		filesystem->io_counters[filesystem->current_io_op].bytes_written += result;
 		i += result;
 	}
 	return len;
 }
-int readall(int fd, void *buffer, size_t len, uint64_t offset){
-	for (int i = 0; i < len;){
-		int result = pread(fd,buffer+i,len-i,offset);
+int readall(sfs_t *filesystem, void *buffer, size_t len, uint64_t offset){
+	if (filesystem->flags & SFS_FUNC_FLAG_DIRECT_IO){
+		return (direct_transfer(filesystem,buffer,len,offset,0) == 0) ? (int)len : -1;
+	}
+	for (size_t i = 0; i < len;){
+		SFS_PROBE2(image__read,offset+i,len-i);
+		ssize_t result = pread(filesystem->filesystem_fd,buffer+i,len-i,offset+i);
+		filesystem->io_counters[filesystem->current_io_op].reads++;
 		if (result < 0){
-			PERROR("pwrite");
+			PERROR("pread");
+			return -1;
+		}
+		filesystem->io_counters[filesystem->current_io_op].bytes_read += result;
+		if (result == 0){
+			//past the end of the image
+			errno = EIO;
 			return -1;
 		}
 		i += result;
@@ -56,65 +264,189 @@ int readall(int fd, void *buffer, size_t len, uint64_t offset){
 	return len;
 }
 
+//called from outside libsfs these move file data, so their I/O is charged to file_read / file_write
+//(the call itself is counted by sfs_account_file_io, as one request can take several of these)
+int sfs_image_read(sfs_t *filesystem,void *buffer,size_t len,uint64_t offset){
+	enum sfs_io_op previous_op = filesystem->current_io_op;
+	if (previous_op == SFS_IO_OP_NONE) filesystem->current_io_op = SFS_IO_OP_FILE_READ;
+	int result = (readall(filesystem,buffer,len,offset) < 0) ? -1 : 0;
+	filesystem->current_io_op = previous_op;
+	return result;
+}
+int sfs_image_write(sfs_t *filesystem,const void *buffer,size_t len,uint64_t offset){
+	enum sfs_io_op previous_op = filesystem->current_io_op;
+	if (previous_op == SFS_IO_OP_NONE) filesystem->current_io_op = SFS_IO_OP_FILE_WRITE;
+	int result = (writeall(filesystem,buffer,len,offset) < 0) ? -1 : 0;
+	filesystem->current_io_op = previous_op;
+	return result;
+}
+
 int sfs_open_fs(sfs_t *filesystem,const char *path,int flags){
 	//====== open the filesystem ======
 	memset(filesystem,0,sizeof(sfs_t));
 	int open_flags = O_RDWR;
 	//allow it to be created if requested
 	if ((flags & SFS_FUNC_FLAG_O_CREATE) != 0) open_flags |= O_CREAT;
+	//bypass the host page cache, libsfs and the kernel fuse cache are the only caches left
+	if ((flags & SFS_FUNC_FLAG_DIRECT_IO) != 0) open_flags |= O_DIRECT;
 	int filesystem_fd = open(path,open_flags,0666);
 	if (filesystem_fd < 0){
 		return -1;
 	}
 	filesystem->filesystem_fd = filesystem_fd;
+	filesystem->flags = flags;
+	if ((flags & SFS_FUNC_FLAG_DIRECT_IO) != 0){
+		//block devices can need more than the default, but never less
+		filesystem->direct_alignment = SFS_DIRECT_IO_ALIGNMENT;
+		int sector_size;
+		if (image_is_block_device(filesystem) && ioctl(filesystem_fd,BLKSSZGET,&sector_size) == 0 && sector_size > SFS_DIRECT_IO_ALIGNMENT){
+			filesystem->direct_alignment = sector_size;
+		}
+	}
 
 	//if skip superblock check flag on
 	if ((flags & SFS_FUNC_FLAG_SKIP_SUPERBLOCK_CHECK) != 0) return 0;
 
-	printf("reading superblock\n");
+	LOG_DEBUG("reading superblock");
 	//====== attempt to read the superblock ======
 	//read the magic number
 	uint32_t magic_number;
-	ssize_t bytes_read = read(filesystem_fd,&magic_number,sizeof(magic_number));
+	ssize_t bytes_read = image_read(filesystem,&magic_number,sizeof(magic_number));
 	if (bytes_read < sizeof(magic_number)){
-		close(filesystem_fd);
+		close_image(filesystem);
 		return -1;
 	}
 	//verify magic number
 	if (be32toh(magic_number) != SFS_MAGIC_NO){
-		close(filesystem_fd);
+		close_image(filesystem);
 		return E_MALFORMED_SUPERBLOCK;
 	}
 	//read page count
 	uint64_t page_count;
-	bytes_read = read(filesystem_fd,&page_count,sizeof(page_count));
+	bytes_read = image_read(filesystem,&page_count,sizeof(page_count));
 	if (bytes_read < sizeof(page_count)){
-		close(filesystem_fd);
+		close_image(filesystem);
 		return -1;
 	}
 	filesystem->page_count = be64toh(page_count);
 	//read first free index  
 	uint64_t first_free_page_index;
-	bytes_read = read(filesystem_fd,&first_free_page_index,sizeof(first_free_page_index));
+	bytes_read = image_read(filesystem,&first_free_page_index,sizeof(first_free_page_index));
 	if (bytes_read < sizeof(first_free_page_index)){
-		close(filesystem_fd);
+		close_image(filesystem);
 		return -1;
 	}
 	filesystem->first_free_page_index = be64toh(first_free_page_index);
 	//read the current generation number
 	uint64_t current_generation_number;
-	bytes_read = read(filesystem_fd,&current_generation_number,sizeof(current_generation_number));
+	bytes_read = image_read(filesystem,&current_generation_number,sizeof(current_generation_number));
 	if (bytes_read < sizeof(current_generation_number)){
-		close(filesystem_fd);
+		close_image(filesystem);
 		return -1;
 	}
 	filesystem->current_generation_number = be64toh(current_generation_number);
+	//read the high water mark (0 on images made before it existed, which have every page on the free list)
+	uint64_t high_water_mark;
+	bytes_read = image_read(filesystem,&high_water_mark,sizeof(high_water_mark));
+	if (bytes_read < sizeof(high_water_mark)){
+		close_image(filesystem);
+		return -1;
+	}
+	filesystem->high_water_mark = be64toh(high_water_mark);
+	if (filesystem->high_water_mark == 0 || filesystem->high_water_mark > filesystem->page_count){
+		filesystem->high_water_mark = filesystem->page_count;
+	}
+	//read the orphan list (0 on images made before it existed, page 0 is never an inode)
+	uint64_t orphan_list_head;
+	bytes_read = image_read(filesystem,&orphan_list_head,sizeof(orphan_list_head));
+	if (bytes_read < sizeof(orphan_list_head)){
+		close_image(filesystem);
+		return -1;
+	}
+	filesystem->orphan_list_head = be64toh(orphan_list_head);
+	if (filesystem->orphan_list_head >= filesystem->page_count) filesystem->orphan_list_head = 0;
+	//a block device can not grow to fit like a sparse file can
+	if (image_is_block_device(filesystem)){
+		uint64_t capacity;
+		if (image_capacity(filesystem,&capacity) != 0){
+			close_image(filesystem);
+			return -1;
+		}
+		if (capacity < SFS_SUPERBLOCK_SIZE+SFS_PAGE_SIZE*filesystem->page_count){
+			close_image(filesystem);
+			errno = ENOSPC;
+			return -1;
+		}
+	}
+	return 0;
+}
+int sfs_create_fs(sfs_t *filesystem,const char *path,uint64_t page_count,int flags){
+	if (sfs_open_fs(filesystem,path,flags | SFS_FUNC_FLAG_SKIP_SUPERBLOCK_CHECK | SFS_FUNC_FLAG_O_CREATE) != 0) return -1;
+	int block_device = image_is_block_device(filesystem);
+	//====== fill whatever is already there ======
+	if (page_count == 0){
+		uint64_t capacity;
+		if (image_capacity(filesystem,&capacity) != 0) goto error;
+		page_count = (capacity < SFS_SUPERBLOCK_SIZE) ? 0 : (capacity-SFS_SUPERBLOCK_SIZE)/SFS_PAGE_SIZE;
+	}
+	//the superblock, an unused page 0 and the root directory
+	if (page_count < 2){
+		errno = EINVAL;
+		goto error;
+	}
+	filesystem->page_count = page_count;
+	//nothing has been freed yet, every page past the root is handed out from the high water mark
+	filesystem->first_free_page_index = (uint64_t)-1;
+	filesystem->high_water_mark = 2;
+	filesystem->current_generation_number = 1;
+	//====== size the image, dropping anything that was there before ======
+	//the pages are never read before they are allocated, so the file stays sparse until they are written
+	off_t image_size = SFS_SUPERBLOCK_SIZE+SFS_PAGE_SIZE*page_count;
+	if (block_device){
+		uint64_t capacity;
+		if (image_capacity(filesystem,&capacity) != 0) goto error;
+		if (capacity < image_size){
+			errno = ENOSPC;
+			goto error;
+		}
+	}else{
+		//O_DIRECT writes whole blocks, so the last page has to be followed by the rest of its block
+		if (flags & SFS_FUNC_FLAG_DIRECT_IO) image_size = (image_size+filesystem->direct_alignment-1) & ~(off_t)(filesystem->direct_alignment-1);
+		if (ftruncate(filesystem->filesystem_fd,0) != 0 || ftruncate(filesystem->filesystem_fd,image_size) != 0) goto error;
+		if ((flags & SFS_FUNC_FLAG_FALLOCATE) && fallocate(filesystem->filesystem_fd,0,0,image_size) != 0) goto error;
+	}
+	//====== root directory ======
+	sfs_inode_t root_inode = {
+		.mode = S_IFDIR | 0755,
+		.uid = getuid(),
+		.gid = getgid(),
+		.page = 1,
+		.parent_inode_pointer = 1,
+		.pointer_count = 0,
+		.next_page = (uint64_t)-1,
+		.previous_page = (uint64_t)-1,
+		.name = {"/"},
+		.generation_number = 0
+	};
+	if (sfs_write_inode_header(filesystem,1,&root_inode) != 0) goto error;
+	if (sfs_update_superblock(filesystem) != 0) goto error;
 	return 0;
+
+	error:
+	int error = errno;
+	close_image(filesystem);
+	errno = error;
+	return -1;
 }
 int sfs_close_fs(sfs_t *filesystem,int flags){
 	int return_val = 0;
+	//put any cached free pages back on the list before the superblock records its head
+	int result = sfs_flush_free_pages(filesystem);
+	if (result < 0){
+		return_val = result;
+	}
 	//update the superblock
-	int result = sfs_update_superblock(filesystem);
+	result = sfs_update_superblock(filesystem);
 	if (result < 0){
 		return_val = result;
 	}
@@ -123,34 +455,35 @@ int sfs_close_fs(sfs_t *filesystem,int flags){
 	if (result < 0){
 		return_val = result;
 	}
+	free(filesystem->direct_buffer);
 	//return the status
 	return return_val;
 }
 
 int sfs_update_superblock(sfs_t *filesystem){
-	int filesystem_fd = filesystem->filesystem_fd;
-	//====== go to begining ======
-	off_t position = lseek(filesystem_fd,0,SEEK_SET);
-	if (position == (off_t)-1){
-		return -1;
-	}
-	//====== write the fields (with endianness corrected) ======
+	OPERATION(filesystem,SFS_IO_OP_SUPERBLOCK_UPDATE,"sfs_update_superblock");
+	//====== pack the fields (with endianness corrected) ======
+	//and write them in one go, so an O_DIRECT image only rewrites the first block once
+	char superblock[4+8*5];
 	//4 byte magic number
 	uint32_t magic_number = htobe32(SFS_MAGIC_NO);
-	int result = write(filesystem_fd,&magic_number,sizeof(magic_number));
-	if (result < sizeof(magic_number)) return -1;
+	memcpy(superblock,&magic_number,sizeof(magic_number));
 	//8 byte page count
 	uint64_t page_count = htobe64(filesystem->page_count);
-	result = write(filesystem_fd,&page_count,sizeof(page_count));
-	if (result < sizeof(page_count)) return -1;
+	memcpy(superblock+4,&page_count,sizeof(page_count));
 	//8 byte first free page
 	uint64_t first_free_page_index = htobe64(filesystem->first_free_page_index);
-	result = write(filesystem_fd,&first_free_page_index,sizeof(first_free_page_index));
-	if (result < sizeof(first_free_page_index)) return -1;
+	memcpy(superblock+12,&first_free_page_index,sizeof(first_free_page_index));
 	//8 bytes current generation number
 	uint64_t current_generation_number = htobe64(filesystem->current_generation_number);
-	result = write(filesystem_fd,&current_generation_number,sizeof(current_generation_number));
-	if (result < sizeof(current_generation_number)) return -1;
+	memcpy(superblock+20,&current_generation_number,sizeof(current_generation_number));
+	//8 bytes high water mark
+	uint64_t high_water_mark = htobe64(filesystem->high_water_mark);
+	memcpy(superblock+28,&high_water_mark,sizeof(high_water_mark));
+	//8 bytes first orphaned inode
+	uint64_t orphan_list_head = htobe64(filesystem->orphan_list_head);
+	memcpy(superblock+36,&orphan_list_head,sizeof(orphan_list_head));
+	if (writeall(filesystem,superblock,sizeof(superblock),0) < 0) return -1;
 	return 0;
 }
 uint64_t sfs_page_offset(sfs_t *filesystem,uint64_t page){
@@ -162,85 +495,173 @@ uint64_t sfs_page_offset(sfs_t *filesystem,uint64_t page){
 	return SFS_SUPERBLOCK_SIZE+(SFS_PAGE_SIZE*page);
 }
 int sfs_seek_to_page(sfs_t *filesystem,uint64_t page){
-	off64_t offset = SFS_SUPERBLOCK_SIZE+(SFS_PAGE_SIZE*page);
-	off64_t offset_result = lseek64(filesystem->filesystem_fd,offset,SEEK_SET);
-	if (offset_result == (off64_t)-1){
-		PERROR("lseek64");
+	off_t offset = SFS_SUPERBLOCK_SIZE+(SFS_PAGE_SIZE*page);
+	off_t offset_result = image_seek(filesystem,offset,SEEK_SET);
+	if (offset_result == (off_t)-1){
+		PERROR("lseek");
 		return -1;
 	}
 	return 0;
 }
-int sfs_free_page(sfs_t *filesystem,uint64_t page){
-	int result = sfs_seek_to_page(filesystem,page);
-	if (result < 0){
-		return result;
-	}
-	//====== point the new free page to the previous first free page ======
-	//if there are no previous free pages
-	uint64_t next_free_page_index; //like NULL at the end of a linked list
-	if (filesystem->first_free_page_index == (uint64_t)-1){
-		filesystem->first_free_page_index = page; //update the head pointer
-		next_free_page_index = htobe64((uint64_t)-1);
-	}else{
-	//if there is a previous free page, point to it and point the first free page pointer here
-		next_free_page_index = htobe64(filesystem->first_free_page_index);
-		filesystem->first_free_page_index = page;
-	}
-	//====== write the page header ======
-	//1 byte of the page type
-	uint8_t page_identifier = SFS_FREE_PAGE_IDENTIFIER;
-	result = write(filesystem->filesystem_fd,&page_identifier,sizeof(uint8_t));
-	if (result < sizeof(page_identifier)){
-		PERROR("write");
-		return -1;
+//====== free page cache ======
+//free pages are kept in a small stack in memory. allocating pops it and freeing pushes it, so most of the time neither touches the image.
+//when it runs dry a batch is taken off the front of the on disk free list at once, and when it fills up half of it is threaded back on at once,
+//with SFS_FUNC_FLAG_PUNCH_HOLES pages that are next to each other are written as a single run and hole punched,
+//otherwise every page gets the plain free page header, so images nobody opted in on stay readable by older libsfs.
+//the list on disk is only complete again after sfs_flush_free_pages or sfs_close_fs, a crash before then leaks the pages that were cached.
+//a refill writes the new head to the superblock before handing any of its pages out, so the list on disk never covers a page in use
+static int page_index_cmp(const void *a,const void *b){
+	uint64_t page_a = *(const uint64_t *)a;
+	uint64_t page_b = *(const uint64_t *)b;
+	return (page_a > page_b) - (page_a < page_b);
+}
+//writes the header at the start of a free run. single pages use the plain free page header so older versions can still follow the list
+static int write_free_run_header(sfs_t *filesystem,uint64_t page,uint64_t length,uint64_t next_free_page_index){
+	uint64_t offset = sfs_page_offset(filesystem,page);
+	if (offset == (uint64_t)-1) return -1;
+	char header[SFS_FREE_RUN_HEADER_SIZE];
+	uint64_t next = htobe64(next_free_page_index);
+	uint64_t run_length = htobe64(length);
+	header[0] = (length == 1) ? SFS_FREE_PAGE_IDENTIFIER : SFS_FREE_RUN_IDENTIFIER;
+	memcpy(header+1,&next,sizeof(next));
+	memcpy(header+1+sizeof(next),&run_length,sizeof(run_length));
+	size_t header_size = (length == 1) ? 1+sizeof(next) : SFS_FREE_RUN_HEADER_SIZE;
+	if (writeall(filesystem,header,header_size,offset) < 0) return -1;
+	return 0;
+}
+//put the bottom count pages of the cache back on the front of the free list
+static int flush_cached_pages(sfs_t *filesystem,uint32_t count){
+	if (count == 0) return 0;
+	//in page order, so neighbouring pages become one run and allocation after a refill goes up the image
+	uint64_t pages[SFS_FREE_PAGE_CACHE_SIZE];
+	memcpy(pages,filesystem->free_page_cache,sizeof(uint64_t)*count);
+	qsort(pages,count,sizeof(uint64_t),page_index_cmp);
+	int make_runs = (filesystem->flags & SFS_FUNC_FLAG_PUNCH_HOLES) != 0;
+	for (uint32_t i = 0; i < count;){
+		uint32_t length = 1;
+		while (make_runs && i+length < count && pages[i+length] == pages[i]+length) length++;
+		uint64_t next_free_page_index = (i+length < count) ? pages[i+length] : filesystem->first_free_page_index;
+		if (write_free_run_header(filesystem,pages[i],length,next_free_page_index) != 0) return -1;
+		//only the first page of a run holds anything, give the rest back to the host
+		if (length > 1){
+			uint64_t offset = sfs_page_offset(filesystem,pages[i]+1);
+			if (fallocate(filesystem->filesystem_fd,FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,offset,(uint64_t)(length-1)*SFS_PAGE_SIZE) != 0){
+				PERROR("fallocate");
+				return -1;
+			}
+		}
+		i += length;
 	}
-	//8 bytes of next free page index
-	result = write(filesystem->filesystem_fd,&next_free_page_index,sizeof(next_free_page_index));
-	if (result < sizeof(next_free_page_index)){
-		PERROR("write");
+	//only drop them from the cache once they are all safely on the list
+	filesystem->first_free_page_index = pages[0];
+	filesystem->free_page_cache_count -= count;
+	memmove(filesystem->free_page_cache,filesystem->free_page_cache+count,sizeof(uint64_t)*filesystem->free_page_cache_count);
+	return 0;
+}
+//take up to half a cache worth of pages off the front of the free list
+static int refill_page_cache(sfs_t *filesystem){
+	uint64_t pages[SFS_FREE_PAGE_CACHE_SIZE/2];
+	uint32_t count = 0;
+	uint64_t old_head = filesystem->first_free_page_index;
+	uint64_t head = old_head;
+	while (count < SFS_FREE_PAGE_CACHE_SIZE/2 && head != (uint64_t)-1){
+		uint64_t offset = sfs_page_offset(filesystem,head);
+		if (offset == (uint64_t)-1) return -1;
+		//type byte, next free page, then the run length if it is a run
+		char header[SFS_FREE_RUN_HEADER_SIZE];
+		uint64_t next_free_page_index;
+		uint64_t run_length = 1;
+		if (readall(filesystem,header,sizeof(header),offset) < 0) return -1;
+		memcpy(&next_free_page_index,header+1,sizeof(next_free_page_index));
+		next_free_page_index = be64toh(next_free_page_index);
+		if (header[0] == SFS_FREE_RUN_IDENTIFIER){
+			memcpy(&run_length,header+1+sizeof(next_free_page_index),sizeof(run_length));
+			run_length = be64toh(run_length);
+			if (run_length == 0 || run_length > filesystem->page_count-head){
+				errno = EFAULT;
+				PERROR("reading free run");
+				return -1;
+			}
+		}
+		uint64_t taken = MIN(run_length,SFS_FREE_PAGE_CACHE_SIZE/2-count);
+		for (uint64_t i = 0; i < taken; i++) pages[count++] = head+i;
+		if (taken < run_length){
+			//leave the rest of the run on the list, starting after the pages taken
+			if (write_free_run_header(filesystem,head+taken,run_length-taken,next_free_page_index) != 0) return -1;
+			head += taken;
+		}else{
+			head = next_free_page_index;
+		}
+	}
+	if (count == 0) return 0;
+	//====== the pages are off the list on disk before any of them is used ======
+	filesystem->first_free_page_index = head;
+	if (sfs_update_superblock(filesystem) != 0){
+		//the old head still describes every page taken
+		filesystem->first_free_page_index = old_head;
 		return -1;
 	}
+	//pushed in reverse so they come back out in list order
+	for (uint32_t i = 0; i < count; i++){
+		filesystem->free_page_cache[filesystem->free_page_cache_count++] = pages[count-1-i];
+	}
 	return 0;
 }
-uint64_t sfs_allocate_page(sfs_t *filesystem){
-	if (filesystem->first_free_page_index == (uint64_t)-1){
-		errno = ENOMEM;
-		PERROR("allocating page");
+int sfs_flush_free_pages(sfs_t *filesystem){
+	OPERATION(filesystem,SFS_IO_OP_PAGE_FREE,"sfs_flush_free_pages");
+	return flush_cached_pages(filesystem,filesystem->free_page_cache_count);
+}
+int sfs_free_page(sfs_t *filesystem,uint64_t page){
+	OPERATION(filesystem,SFS_IO_OP_PAGE_FREE,"sfs_free_page");
+	SFS_PROBE1(page__free,page);
+	if (page >= filesystem->page_count){
+		errno = EFAULT;
+		PERROR("freeing page");
 		return -1;
 	}
-	
-	//====== go to the first free page to find the next free page ======
-	int result = sfs_seek_to_page(filesystem,filesystem->first_free_page_index);
-	if (result < 0){
+	//never handed out, the high water mark will hand it out again without looking at the free list
+	if (page >= filesystem->high_water_mark){
+		errno = EINVAL;
+		PERROR("freeing page above the high water mark");
 		return -1;
 	}
-	//skip the page identifier bit
-	off_t offset_result = lseek(filesystem->filesystem_fd,1,SEEK_CUR);
-	if (offset_result == (off_t)-1){
-		PERROR("lseek");
-		return -1;
+	//make room by putting the pages that have been sitting there longest back on the list
+	if (filesystem->free_page_cache_count == SFS_FREE_PAGE_CACHE_SIZE){
+		if (flush_cached_pages(filesystem,SFS_FREE_PAGE_CACHE_SIZE/2) != 0) return -1;
 	}
-	uint64_t next_free_page_index;
-	result = read(filesystem->filesystem_fd,&next_free_page_index,sizeof(next_free_page_index));
-	if (result < 0){
-		PERROR("read");
-		return -1;
+	filesystem->free_page_cache[filesystem->free_page_cache_count++] = page;
+	return 0;
+}
+uint64_t sfs_allocate_page(sfs_t *filesystem){
+	OPERATION(filesystem,SFS_IO_OP_PAGE_ALLOCATE,"sfs_allocate_page");
+	if (filesystem->free_page_cache_count == 0){
+		if (refill_page_cache(filesystem) != 0) return -1;
+	}
+	if (filesystem->free_page_cache_count == 0){
+		//====== nothing recycled, take a page that has never been used ======
+		//no need to read it, there is nothing there
+		if (filesystem->high_water_mark >= filesystem->page_count){
+			errno = ENOMEM;
+			PERROR("allocating page");
+			return -1;
+		}
+		uint64_t new_page = filesystem->high_water_mark++;
+		SFS_PROBE1(page__alloc,new_page);
+		return new_page;
 	}
-	//get the value to return
-	uint64_t new_free_page = filesystem->first_free_page_index;
-	//update the next free page
-	filesystem->first_free_page_index = be64toh(next_free_page_index);
-
-	return new_free_page;
+	uint64_t new_page = filesystem->free_page_cache[--filesystem->free_page_cache_count];
+	SFS_PROBE1(page__alloc,new_page);
+	return new_page;
 }
 int sfs_write_inode_header(sfs_t *filesystem,uint64_t page,sfs_inode_t *inode){
+	OPERATION(filesystem,SFS_IO_OP_INODE_HEADER_WRITE,"sfs_write_inode_header");
+	SFS_PROBE3(inode__header__write,page,inode->pointer_count,inode->size);
 	//====== go to the inode ======
 	int result = sfs_seek_to_page(filesystem,page);
 	if (result < 0){
 		PERROR("write");
 		return -1;
 	}
-	int fd = filesystem->filesystem_fd;
 	//====== copy and correct endianness ======
 	//we dont want to modify the users struct
 	sfs_inode_t inode_cpy = {};
@@ -256,7 +677,7 @@ int sfs_write_inode_header(sfs_t *filesystem,uint64_t page,sfs_inode_t *inode){
 	inode_cpy.gid = htobe32(inode_cpy.gid);
 	inode_cpy.size = htobe64(inode_cpy.size);
 	//====== write the struct ======
-	result = write(fd,&inode_cpy,sizeof(sfs_inode_t));
+	result = image_write(filesystem,&inode_cpy,sizeof(sfs_inode_t));
 	if (result < sizeof(sfs_inode_t)){
 		PERROR("write");
 		return -1;
@@ -264,14 +685,14 @@ int sfs_write_inode_header(sfs_t *filesystem,uint64_t page,sfs_inode_t *inode){
 	return 0;
 }
 int sfs_read_inode_header(sfs_t *filesystem,uint64_t page,sfs_inode_t *inode){
+	OPERATION(filesystem,SFS_IO_OP_INODE_HEADER_READ,"sfs_read_inode_header");
 	//====== go to the inode ======
 	int result = sfs_seek_to_page(filesystem,page);
 	if (result < 0){
 		return -1;
 	}
-	int fd = filesystem->filesystem_fd;
 	//====== read into the struct ======
-	result = read(fd,inode,sizeof(sfs_inode_t));
+	result = image_read(filesystem,inode,sizeof(sfs_inode_t));
 	if (result < sizeof(sfs_inode_t)){
 		PERROR("read");
 		return -1;
@@ -287,6 +708,7 @@ int sfs_read_inode_header(sfs_t *filesystem,uint64_t page,sfs_inode_t *inode){
 	inode->uid = be32toh(inode->uid);
 	inode->gid = be32toh(inode->gid);
 	inode->size = be64toh(inode->size);
+	SFS_PROBE3(inode__header__read,page,inode->pointer_count,inode->size);
 	return 0;
 }
 void sfs_print_info(){
@@ -470,7 +892,7 @@ int sfs_inode_seek_to_pointer(sfs_t *filesystem,uint64_t inode,uint64_t index){
 		return -1;
 	}
 	uint64_t index_in_page = index%SFS_INODE_MAX_POINTERS;
-	result = lseek(filesystem->filesystem_fd,SFS_INODE_ALIGNED_HEADER_SIZE+(sizeof(uint64_t)*index_in_page),SEEK_CUR);
+	result = image_seek(filesystem,SFS_INODE_ALIGNED_HEADER_SIZE+(sizeof(uint64_t)*index_in_page),SEEK_CUR);
 	if (result < 0){
 		PERROR("lseek");
 		return -1;
@@ -478,19 +900,21 @@ int sfs_inode_seek_to_pointer(sfs_t *filesystem,uint64_t inode,uint64_t index){
 	return 0;
 }
 uint64_t sfs_inode_get_pointer(sfs_t *filesystem,uint64_t inode,uint64_t index){
+	OPERATION(filesystem,SFS_IO_OP_POINTER_GET,"sfs_inode_get_pointer");
 	uint64_t offset = sfs_inode_pointer_offset(filesystem,inode,index);
 	if (offset == (uint64_t)-1){
 		return -1;
 	}
 	//====== read the pointer ======
 	uint64_t pointer;
-	int result = readall(filesystem->filesystem_fd,&pointer,sizeof(pointer),offset);
+	int result = readall(filesystem,&pointer,sizeof(pointer),offset);
 	if (result < 0){
 		return (uint64_t)-1;
 	}
 	return be64toh(pointer);
 }
 int sfs_inode_set_pointer(sfs_t *filesystem,uint64_t inode,uint64_t index,uint64_t pointer){
+	OPERATION(filesystem,SFS_IO_OP_POINTER_SET,"sfs_inode_set_pointer");
 	uint64_t offset = sfs_inode_pointer_offset(filesystem,inode,index);
 	if (offset == (uint64_t)-1){
 		return -1;
@@ -498,12 +922,208 @@ int sfs_inode_set_pointer(sfs_t *filesystem,uint64_t inode,uint64_t index,uint64
 	//====== write the pointer ======
 	//correct endianness
 	uint64_t corrected_pointer = htobe64(pointer);
-	int result = writeall(filesystem->filesystem_fd,&corrected_pointer,sizeof(corrected_pointer),offset);
+	int result = writeall(filesystem,&corrected_pointer,sizeof(corrected_pointer),offset);
 	if (result < 0){
 		return -1;
 	}
 	return 0;
 }
+//====== pointer ranges ======
+//a run of pointers is stored big endian and back to back, so a whole run is converted in one pass once it is in memory
+static void pointers_be64toh(uint64_t pointers[],size_t count){
+	for (size_t i = 0; i < count; i++) pointers[i] = be64toh(pointers[i]);
+}
+static void pointers_htobe64(uint64_t pointers[],size_t count){
+	for (size_t i = 0; i < count; i++) pointers[i] = htobe64(pointers[i]);
+}
+//checks the range is inside the inode and finds the page that pointer start is on, and where the chain goes next
+static uint64_t pointer_range_start(sfs_t *filesystem,uint64_t inode,uint64_t start,uint64_t count,uint64_t *next_page_return){
+	sfs_inode_t current_inode;
+	if (sfs_read_inode_header(filesystem,inode,&current_inode) < 0) return -1;
+	if (start > current_inode.pointer_count || count > current_inode.pointer_count-start){
+		errno = EFAULT;
+		PERROR("current_inode.pointer_count");
+		return -1;
+	}
+	uint64_t current_page = inode;
+	for (uint64_t hops = start/SFS_INODE_MAX_POINTERS; hops > 0; hops--){
+		if (current_inode.next_page == (uint64_t)-1){
+			errno = EFAULT;
+			PERROR("pointer_range_start");
+			return -1;
+		}
+		current_page = current_inode.next_page;
+		if (sfs_read_inode_header(filesystem,current_page,&current_inode) < 0) return -1;
+	}
+	*next_page_return = current_inode.next_page;
+	return current_page;
+}
+int sfs_inode_get_pointers(sfs_t *filesystem,uint64_t inode,uint64_t start,uint64_t count,uint64_t pointers[]){
+	OPERATION(filesystem,SFS_IO_OP_POINTER_GET,"sfs_inode_get_pointers");
+	if (count == 0) return 0;
+	uint64_t next_page;
+	uint64_t page = pointer_range_start(filesystem,inode,start,count,&next_page);
+	if (page == (uint64_t)-1) return -1;
+	//====== one read per page ======
+	//the header is read along with the pointers, for the next page in the chain
+	char page_buffer[SFS_PAGE_SIZE];
+	for (uint64_t done = 0; done < count;){
+		uint64_t index_in_page = (start+done)%SFS_INODE_MAX_POINTERS;
+		uint64_t pointers_in_page = MIN(SFS_INODE_MAX_POINTERS-index_in_page,count-done);
+		uint64_t page_offset = sfs_page_offset(filesystem,page);
+		if (page_offset == (uint64_t)-1) return -1;
+		size_t pointers_offset = SFS_INODE_ALIGNED_HEADER_SIZE+sizeof(uint64_t)*index_in_page;
+		int first_page = (done == 0);
+		if (first_page){
+			//already have the header
+			if (readall(filesystem,pointers+done,sizeof(uint64_t)*pointers_in_page,page_offset+pointers_offset) < 0) return -1;
+		}else{
+			if (readall(filesystem,page_buffer,pointers_offset+sizeof(uint64_t)*pointers_in_page,page_offset) < 0) return -1;
+			memcpy(pointers+done,page_buffer+pointers_offset,sizeof(uint64_t)*pointers_in_page);
+			memcpy(&next_page,page_buffer+offsetof(sfs_inode_t,next_page),sizeof(next_page));
+			next_page = be64toh(next_page);
+		}
+		pointers_be64toh(pointers+done,pointers_in_page);
+		done += pointers_in_page;
+		if (done < count){
+			if (next_page == (uint64_t)-1){
+				errno = EFAULT;
+				PERROR("sfs_inode_get_pointers");
+				return -1;
+			}
+			page = next_page;
+		}
+	}
+	return 0;
+}
+int sfs_inode_set_pointers(sfs_t *filesystem,uint64_t inode,uint64_t start,uint64_t count,const uint64_t pointers[]){
+	OPERATION(filesystem,SFS_IO_OP_POINTER_SET,"sfs_inode_set_pointers");
+	if (count == 0) return 0;
+	uint64_t next_page;
+	uint64_t page = pointer_range_start(filesystem,inode,start,count,&next_page);
+	if (page == (uint64_t)-1) return -1;
+	//====== one write per page ======
+	uint64_t corrected_pointers[SFS_INODE_MAX_POINTERS];
+	for (uint64_t done = 0; done < count;){
+		uint64_t index_in_page = (start+done)%SFS_INODE_MAX_POINTERS;
+		uint64_t pointers_in_page = MIN(SFS_INODE_MAX_POINTERS-index_in_page,count-done);
+		uint64_t page_offset = sfs_page_offset(filesystem,page);
+		if (page_offset == (uint64_t)-1) return -1;
+		memcpy(corrected_pointers,pointers+done,sizeof(uint64_t)*pointers_in_page);
+		pointers_htobe64(corrected_pointers,pointers_in_page);
+		if (writeall(filesystem,corrected_pointers,sizeof(uint64_t)*pointers_in_page,page_offset+SFS_INODE_ALIGNED_HEADER_SIZE+sizeof(uint64_t)*index_in_page) < 0) return -1;
+		done += pointers_in_page;
+		if (done < count){
+			if (next_page == (uint64_t)-1){
+				errno = EFAULT;
+				PERROR("sfs_inode_set_pointers");
+				return -1;
+			}
+			page = next_page;
+			//only the next pointer is needed from the header
+			if (readall(filesystem,&next_page,sizeof(next_page),sfs_page_offset(filesystem,page)+offsetof(sfs_inode_t,next_page)) < 0) return -1;
+			next_page = be64toh(next_page);
+		}
+	}
+	return 0;
+}
+//shrinks an inode to count pointers in one pass down the chain of continuation pages, freeing the ones no longer needed
+//with free_targets the pages the dropped pointers point to are freed too (truncating a file)
+//the header is only written once, at the end
+static int truncate_pointers(sfs_t *filesystem,uint64_t inode,uint64_t count,int free_targets){
+	sfs_inode_t inode_header;
+	if (sfs_read_inode_header(filesystem,inode,&inode_header) < 0) return -1;
+	uint64_t old_count = inode_header.pointer_count;
+	if (count > old_count){
+		errno = EINVAL;
+		return -1;
+	}
+	//====== go to the last page that is kept ======
+	//(there is always at least the inode page itself)
+	uint64_t kept_pages = MAX(1,(count+SFS_INODE_MAX_POINTERS-1)/SFS_INODE_MAX_POINTERS);
+	uint64_t last_kept_page = inode;
+	sfs_inode_t last_kept_header = inode_header;
+	for (uint64_t i = 1; i < kept_pages; i++){
+		if (last_kept_header.next_page == (uint64_t)-1){
+			errno = EFAULT;
+			PERROR("truncate_pointers");
+			return -1;
+		}
+		last_kept_page = last_kept_header.next_page;
+		if (sfs_read_inode_header(filesystem,last_kept_page,&last_kept_header) < 0) return -1;
+	}
+	uint64_t pointers[SFS_INODE_MAX_POINTERS];
+	//====== the end of the last kept page ======
+	uint64_t page_end = MIN(old_count,kept_pages*SFS_INODE_MAX_POINTERS);
+	if (free_targets && count < page_end){
+		uint64_t index_in_page = count-(kept_pages-1)*SFS_INODE_MAX_POINTERS;
+		uint64_t offset = sfs_page_offset(filesystem,last_kept_page);
+		if (offset == (uint64_t)-1) return -1;
+		if (readall(filesystem,pointers,sizeof(uint64_t)*(page_end-count),offset+SFS_INODE_ALIGNED_HEADER_SIZE+sizeof(uint64_t)*index_in_page) < 0) return -1;
+		pointers_be64toh(pointers,page_end-count);
+		for (uint64_t i = 0; i < page_end-count; i++){
+			if (sfs_free_page(filesystem,pointers[i]) < 0) return -1;
+		}
+	}
+	//====== every page after it ======
+	//the whole rest of the chain goes, even pages past old_count that should not have been there
+	char page_buffer[SFS_PAGE_SIZE];
+	uint64_t first_index = kept_pages*SFS_INODE_MAX_POINTERS;
+	for (uint64_t page = last_kept_header.next_page, hops = 0; page != (uint64_t)-1; hops++){
+		if (hops > filesystem->page_count){
+			//a looping chain
+			errno = EFAULT;
+			PERROR("truncate_pointers");
+			return -1;
+		}
+		uint64_t pointers_in_page = (first_index < old_count) ? MIN(SFS_INODE_MAX_POINTERS,old_count-first_index) : 0;
+		if (!free_targets) pointers_in_page = 0;
+		uint64_t offset = sfs_page_offset(filesystem,page);
+		if (offset == (uint64_t)-1) return -1;
+		//the header (for the next page) and the pointers in one read
+		if (readall(filesystem,page_buffer,SFS_INODE_ALIGNED_HEADER_SIZE+sizeof(uint64_t)*pointers_in_page,offset) < 0) return -1;
+		memcpy(pointers,page_buffer+SFS_INODE_ALIGNED_HEADER_SIZE,sizeof(uint64_t)*pointers_in_page);
+		pointers_be64toh(pointers,pointers_in_page);
+		for (uint64_t i = 0; i < pointers_in_page; i++){
+			if (sfs_free_page(filesystem,pointers[i]) < 0) return -1;
+		}
+		uint64_t next_page;
+		memcpy(&next_page,page_buffer+offsetof(sfs_inode_t,next_page),sizeof(next_page));
+		if (sfs_free_page(filesystem,page) < 0) return -1;
+		page = be64toh(next_page);
+		first_index += SFS_INODE_MAX_POINTERS;
+	}
+	//====== cut the chain and write the new count ======
+	if (last_kept_page != inode && last_kept_header.next_page != (uint64_t)-1){
+		last_kept_header.next_page = (uint64_t)-1;
+		if (sfs_write_inode_header(filesystem,last_kept_page,&last_kept_header) < 0) return -1;
+	}
+	if (last_kept_page == inode) inode_header.next_page = (uint64_t)-1;
+	inode_header.pointer_count = count;
+	if (sfs_write_inode_header(filesystem,inode,&inode_header) < 0) return -1;
+	return 0;
+}
+//pointers for a run of a file's pages, fetched a window at a time as the caller walks forwards through them
+#define POINTER_WINDOW_SIZE 128
+struct pointer_window {
+	uint64_t inode;
+	uint64_t end; //one past the last index the caller will ask for
+	uint64_t start;
+	uint64_t count;
+	uint64_t pointers[POINTER_WINDOW_SIZE];
+};
+#define POINTER_WINDOW_INIT(inode_number,end_index) {.inode = (inode_number),.end = (end_index),.start = 0,.count = 0}
+static uint64_t pointer_window_get(sfs_t *filesystem,struct pointer_window *window,uint64_t index){
+	if (index < window->start || index >= window->start+window->count){
+		window->start = index;
+		window->count = MIN(POINTER_WINDOW_SIZE,MAX(window->end,index+1)-index);
+		if (sfs_inode_get_pointers(filesystem,window->inode,window->start,window->count,window->pointers) != 0){
+			window->count = 0;
+			return -1;
+		}
+	}
+	return window->pointers[index-window->start];
+}
 int sfs_inode_realocate_pointers(sfs_t *filesystem,uint64_t inode,uint64_t count){
 	//====== read the inode headers ======
 	sfs_inode_t inode_header;
@@ -512,6 +1132,11 @@ int sfs_inode_realocate_pointers(sfs_t *filesystem,uint64_t inode,uint64_t count
 		return -1;
 	}
 	uint64_t old_count = inode_header.pointer_count;
+	//====== remove pages ======
+	//(writes the header itself)
+	if (count < old_count){
+		return truncate_pointers(filesystem,inode,count,0);
+	}
 	//====== write the updated header ======
 	inode_header.pointer_count = count;
 	result = sfs_write_inode_header(filesystem,inode,&inode_header);
@@ -527,7 +1152,8 @@ int sfs_inode_realocate_pointers(sfs_t *filesystem,uint64_t inode,uint64_t count
 		//traverse
 		uint64_t page = inode;
 		uint64_t pages_traversed = 0;
-		uint64_t target_pages_to_traverse = count/SFS_INODE_MAX_POINTERS;
+		//pages after the inode page (an exact multiple of SFS_INODE_MAX_POINTERS fills the last one)
+		uint64_t target_pages_to_traverse = (count+SFS_INODE_MAX_POINTERS-1)/SFS_INODE_MAX_POINTERS-1;
 		for (;pages_traversed < target_pages_to_traverse;pages_traversed++){
 			//if there is no next page allocate a new one
 			if (inode_header.next_page == (uint64_t)-1){
@@ -546,58 +1172,11 @@ int sfs_inode_realocate_pointers(sfs_t *filesystem,uint64_t inode,uint64_t count
 		}
 		return 0;
 	}
-	//====== remove pages ======
-	if (count < old_count){
-		//check if any pages have become redundant
-		uint64_t old_page_count = (old_count+SFS_INODE_MAX_POINTERS-1)/SFS_INODE_MAX_POINTERS; //ceil division
-		uint64_t new_page_count = (count+SFS_INODE_MAX_POINTERS-1)/SFS_INODE_MAX_POINTERS; //ceil division
-		//we need at least one page so dont remove it
-		if (new_page_count < 1) return 0;
-		//only traverse if we need to
-		if (new_page_count < old_page_count){
-			sfs_inode_t current_inode_page;
-			int result = sfs_read_inode_header(filesystem,inode,&current_inode_page);
-			if (result < 0){
-				return -1;
-			}
-			//count the current page
-			new_page_count--;
-			//traverse to the last needed page
-			for (;new_page_count > 0;new_page_count--){
-				uint64_t next_page = current_inode_page.next_page;
-				if (next_page == (uint64_t)-1){
-					//if there werent as many pages as expected, nothing more needs to be done
-					return 0;
-				}
-				int result = sfs_read_inode_header(filesystem,next_page,&current_inode_page);
-				if (result < 0){
-					return -1;
-				}
-			}
-			//for each unwanted page remove it
-			for (;;){
-				uint64_t next_page = current_inode_page.next_page;
-				if (next_page == (uint64_t)-1){
-					//all unwanted pages removed
-					break;
-				}
-				int result = sfs_read_inode_header(filesystem,next_page,&current_inode_page);
-				if (result < 0){
-					return -1;
-				}
-				//the actual removal
-				result = sfs_inode_remove_continuation_page(filesystem,next_page);
-				if (result < 0){
-					return -1;
-				}
-			}
-		}
-		return 0;
-	}
 	//====== it shouldnt be possible to get here ======
 	return -1;
 }
 int sfs_inode_remove_pointer(sfs_t *filesystem,uint64_t inode,uint64_t index){
+	OPERATION(filesystem,SFS_IO_OP_POINTER_REMOVE,"sfs_inode_remove_pointer");
 	//====== rearrange pointers ======
 	/* example: removing pointer 56
 	              p1          step 1: pointer count decreased (range now from p1 to p57)
@@ -636,6 +1215,7 @@ int sfs_inode_remove_pointer(sfs_t *filesystem,uint64_t inode,uint64_t index){
 	return 0;
 }
 int sfs_inode_add_pointer(sfs_t *filesystem,uint64_t inode,uint64_t pointer){
+	OPERATION(filesystem,SFS_IO_OP_POINTER_ADD,"sfs_inode_add_pointer");
 	//====== get info ======
 	sfs_inode_t inode_headers;
 	int result = sfs_read_inode_header(filesystem,inode,&inode_headers);
@@ -655,6 +1235,7 @@ int sfs_inode_add_pointer(sfs_t *filesystem,uint64_t inode,uint64_t pointer){
 	return 0;
 }
 uint64_t sfs_inode_create(sfs_t *filesystem,const char *name,mode_t mode,uid_t uid,gid_t gid,uint64_t parent){
+	OPERATION(filesystem,SFS_IO_OP_INODE_CREATE,"sfs_inode_create");
 	//====== allocate a page ======
 	uint64_t allocated_page = sfs_allocate_page(filesystem);
 	if (allocated_page == (uint64_t)-1){
@@ -686,8 +1267,66 @@ uint64_t sfs_inode_create(sfs_t *filesystem,const char *name,mode_t mode,uid_t u
 	}
 	return allocated_page;
 }
+//====== renaming ======
+//only directory entries and inode headers are touched, never the inode's own pointers, so the cost does not depend on its size
+int sfs_inode_move(sfs_t *filesystem,uint64_t inode,uint64_t old_parent,uint64_t old_index,uint64_t new_parent,uint64_t new_index,const char *new_name){
+	OPERATION(filesystem,SFS_IO_OP_INODE_MOVE,"sfs_inode_move");
+	if (strlen(new_name) >= SFS_MAX_FILENAME_SIZE){
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	sfs_inode_t inode_header;
+	if (sfs_read_inode_header(filesystem,inode,&inode_header) < 0) return -1;
+	//====== the new entry goes in before the old one comes out ======
+	//(a crash in between leaves it in both directories rather than neither)
+	if (new_index != (uint64_t)-1){
+		//takes over the slot of the inode being replaced, which only goes on the orphan list once no directory has it
+		//(a crash in between leaks it rather than freeing one that is still in a directory, the same as unlink)
+		uint64_t replaced = sfs_inode_get_pointer(filesystem,new_parent,new_index);
+		if (replaced == (uint64_t)-1) return -1;
+		if (sfs_inode_set_pointer(filesystem,new_parent,new_index,inode) < 0) return -1;
+		if (sfs_orphan_inode(filesystem,replaced) < 0) return -1;
+		if (sfs_inode_remove_pointer(filesystem,old_parent,old_index) < 0) return -1;
+	}else if (new_parent != old_parent){
+		if (sfs_inode_add_pointer(filesystem,new_parent,inode) < 0) return -1;
+		if (sfs_inode_remove_pointer(filesystem,old_parent,old_index) < 0) return -1;
+	}
+	//(staying in the same directory without replacing anything only changes the name)
+	//====== the name and parent live in the header ======
+	memset(inode_header.name,0,sizeof(inode_header.name));
+	strcpy(inode_header.name,new_name);
+	inode_header.parent_inode_pointer = new_parent;
+	return sfs_write_inode_header(filesystem,inode,&inode_header);
+}
+int sfs_inode_exchange(sfs_t *filesystem,uint64_t parent_a,uint64_t index_a,uint64_t parent_b,uint64_t index_b){
+	OPERATION(filesystem,SFS_IO_OP_INODE_MOVE,"sfs_inode_exchange");
+	uint64_t inode_a = sfs_inode_get_pointer(filesystem,parent_a,index_a);
+	if (inode_a == (uint64_t)-1) return -1;
+	uint64_t inode_b = sfs_inode_get_pointer(filesystem,parent_b,index_b);
+	if (inode_b == (uint64_t)-1) return -1;
+	sfs_inode_t header_a;
+	sfs_inode_t header_b;
+	if (sfs_read_inode_header(filesystem,inode_a,&header_a) < 0) return -1;
+	if (sfs_read_inode_header(filesystem,inode_b,&header_b) < 0) return -1;
+	//====== swap the entries ======
+	//in the same directory they can stay where they are, only the names swap
+	if (parent_a != parent_b){
+		if (sfs_inode_set_pointer(filesystem,parent_a,index_a,inode_b) < 0) return -1;
+		if (sfs_inode_set_pointer(filesystem,parent_b,index_b,inode_a) < 0) return -1;
+	}
+	//====== and the names and parents ======
+	char name_a[SFS_MAX_FILENAME_SIZE];
+	memcpy(name_a,header_a.name,sizeof(name_a));
+	memcpy(header_a.name,header_b.name,sizeof(header_a.name));
+	memcpy(header_b.name,name_a,sizeof(header_b.name));
+	header_a.parent_inode_pointer = parent_b;
+	header_b.parent_inode_pointer = parent_a;
+	if (sfs_write_inode_header(filesystem,inode_a,&header_a) < 0) return -1;
+	return sfs_write_inode_header(filesystem,inode_b,&header_b);
+}
 //                       leave bytes to zero as -1 to fill all new spots with '\0'
 int sfs_file_resize(sfs_t *filesystem,uint64_t inode,uint64_t new_size,int64_t bytes_to_zero){
+	OPERATION(filesystem,SFS_IO_OP_FILE_RESIZE,"sfs_file_resize");
 	//TODO: implement
 	//====== change stored size value ======
 	//read the old
@@ -704,19 +1343,8 @@ int sfs_file_resize(sfs_t *filesystem,uint64_t inode,uint64_t new_size,int64_t b
 	uint64_t new_page_count = new_size/SFS_PAGE_SIZE + ((new_size%SFS_PAGE_SIZE) != 0);
 	if (new_page_count < old_page_count){
 		//====== shrink ======
-		for (uint64_t i = old_page_count-1; i > new_page_count-1; i--){
-			//free the page
-			uint64_t page = sfs_inode_get_pointer(filesystem,inode,i);
-			if (page == -1){
-				return -1;
-			}
-			if (sfs_free_page(filesystem,page) < 0) return -1;
-			//free the pointer
-			int result = sfs_inode_remove_pointer(filesystem,inode,i);
-			if (result != 0){
-				return -1;
-			}
-		}
+		//frees the trailing pages and the continuation pages they were listed on in one pass
+		if (truncate_pointers(filesystem,inode,new_page_count,1) != 0) return -1;
 	}
 	if (new_size > old_size){
 		//====== grow ======
@@ -738,21 +1366,18 @@ int sfs_file_resize(sfs_t *filesystem,uint64_t inode,uint64_t new_size,int64_t b
 			bytes_left = MIN(new_size-old_size,bytes_to_zero);
 			new_size = old_size+bytes_to_zero;
 		}
+		struct pointer_window window = POINTER_WINDOW_INIT(inode,(new_size+SFS_PAGE_SIZE-1)/SFS_PAGE_SIZE);
 		for (; bytes_left > 0;){
 			uint64_t current_page = (new_size-bytes_left)/SFS_PAGE_SIZE;
 			off_t page_offset = (new_size-bytes_left)%SFS_PAGE_SIZE;
 			uint64_t bytes_to_write = MIN(SFS_PAGE_SIZE-page_offset,MIN(bytes_left,SFS_PAGE_SIZE));
-			uint64_t page = sfs_inode_get_pointer(filesystem,inode,current_page);
-			sfs_seek_to_page(filesystem,page);
-			off_t result = lseek(filesystem->filesystem_fd,SEEK_CUR,page_offset);
-			if (result == (off_t)-1){
-				PERROR("lseek");
-				return -1;
-			}
+			uint64_t page = pointer_window_get(filesystem,&window,current_page);
+			if (page == (uint64_t)-1) return -1;
+			uint64_t filesystem_offset = sfs_page_offset(filesystem,page);
+			if (filesystem_offset == (uint64_t)-1) return -1;
 			const char zeros[SFS_PAGE_SIZE] = {0};
-			result = write(filesystem->filesystem_fd,zeros,bytes_to_write);
-			if (result != 0){
-				PERROR("write");
+			int result = writeall(filesystem,zeros,bytes_to_write,filesystem_offset+page_offset);
+			if (result < 0){
 				return -1;
 			}
 			bytes_left-=bytes_to_write;
@@ -762,6 +1387,8 @@ int sfs_file_resize(sfs_t *filesystem,uint64_t inode,uint64_t new_size,int64_t b
 	return 0;
 }
 size_t sfs_file_read(sfs_t *filesystem,uint64_t inode,off_t offset,char buffer[],size_t len){
+	OPERATION(filesystem,SFS_IO_OP_FILE_READ,"sfs_file_read");
+	OPERATION_BYTES(len);
 	//====== read headers ======
 	sfs_inode_t headers;
 	if (sfs_read_inode_header(filesystem,inode,&headers) < 0) return -1;
@@ -775,21 +1402,24 @@ size_t sfs_file_read(sfs_t *filesystem,uint64_t inode,off_t offset,char buffer[]
 		return 0;
 	}
 	//====== do the actual reading ======
+	struct pointer_window window = POINTER_WINDOW_INIT(inode,(offset+len+SFS_PAGE_SIZE-1)/SFS_PAGE_SIZE);
 	for (uint64_t bytes_left = len; bytes_left > 0;){
 		uint64_t current_page = (offset+len-bytes_left)/SFS_PAGE_SIZE;
 		off_t page_offset = (offset+len-bytes_left)%SFS_PAGE_SIZE;
 		uint64_t bytes_to_write = MIN(SFS_PAGE_SIZE-page_offset,MIN(bytes_left,SFS_PAGE_SIZE));
-		uint64_t page = sfs_inode_get_pointer(filesystem,inode,current_page);
+		uint64_t page = pointer_window_get(filesystem,&window,current_page);
+		if (page == (uint64_t)-1) return -1;
 		uint64_t filesystem_offset = sfs_page_offset(filesystem,page);
 		if (filesystem_offset == -1) return -1;
 		uint64_t offset = page_offset+filesystem_offset;
-		int64_t result = readall(filesystem->filesystem_fd,buffer+len-bytes_left,bytes_to_write,offset);
+		int64_t result = readall(filesystem,buffer+len-bytes_left,bytes_to_write,offset);
 		if (result == -1) return -1;
 		bytes_left-=bytes_to_write;
 	}
 	return len;
 }
-size_t sfs_file_write(sfs_t *filesystem,uint64_t inode,off_t offset,const char buffer[],size_t len){
+int sfs_file_grow_for_write(sfs_t *filesystem,uint64_t inode,off_t offset,size_t len){
+	OPERATION(filesystem,SFS_IO_OP_FILE_GROW,"sfs_file_grow_for_write");
 	//====== read headers ======
 	sfs_inode_t headers;
 	if (sfs_read_inode_header(filesystem,inode,&headers) < 0) return -1;
@@ -797,23 +1427,188 @@ size_t sfs_file_write(sfs_t *filesystem,uint64_t inode,off_t offset,const char b
 	uint64_t old_size = headers.size;
 	uint64_t new_size = MAX(old_size,offset+len);
 	//====== grow if required ======
+	//only the gap between the old end and the write needs zeroing, the write covers the rest
 	uint64_t byte_fill = (offset <= old_size) ? 0 : offset-old_size;
 	if (new_size != old_size){
 		if (sfs_file_resize(filesystem,inode,new_size,byte_fill) < 0) return -1;
 	}
+	return 0;
+}
+ssize_t sfs_file_map(sfs_t *filesystem,uint64_t inode,off_t offset,size_t len,struct sfs_extent extents[],size_t max_extents){
+	OPERATION(filesystem,SFS_IO_OP_FILE_MAP,"sfs_file_map");
+	OPERATION_BYTES(len);
+	//====== read headers ======
+	sfs_inode_t headers;
+	if (sfs_read_inode_header(filesystem,inode,&headers) < 0) return -1;
+	uint64_t size = headers.size;
+	//====== adjust len to not overrun ======
+	if (offset >= size) return 0;
+	len = MIN(len,size-offset);
+	//====== walk the pages, merging physically adjacent ones ======
+	size_t extent_count = 0;
+	struct pointer_window window = POINTER_WINDOW_INIT(inode,(offset+len+SFS_PAGE_SIZE-1)/SFS_PAGE_SIZE);
+	for (uint64_t bytes_left = len; bytes_left > 0;){
+		uint64_t current_page = (offset+len-bytes_left)/SFS_PAGE_SIZE;
+		off_t page_offset = (offset+len-bytes_left)%SFS_PAGE_SIZE;
+		uint64_t bytes_in_page = MIN(SFS_PAGE_SIZE-page_offset,bytes_left);
+		uint64_t page = pointer_window_get(filesystem,&window,current_page);
+		if (page == (uint64_t)-1) return -1;
+		uint64_t filesystem_offset = sfs_page_offset(filesystem,page);
+		if (filesystem_offset == (uint64_t)-1) return -1;
+		filesystem_offset += page_offset;
+		if (extent_count > 0 && extents[extent_count-1].image_offset+extents[extent_count-1].len == filesystem_offset){
+			//carries straight on from the previous page
+			extents[extent_count-1].len += bytes_in_page;
+		}else{
+			if (extent_count == max_extents){
+				errno = ENOBUFS;
+				return -1;
+			}
+			extents[extent_count].image_offset = filesystem_offset;
+			extents[extent_count].len = bytes_in_page;
+			extent_count++;
+		}
+		bytes_left -= bytes_in_page;
+	}
+	return extent_count;
+}
+size_t sfs_file_write(sfs_t *filesystem,uint64_t inode,off_t offset,const char buffer[],size_t len){
+	OPERATION(filesystem,SFS_IO_OP_FILE_WRITE,"sfs_file_write");
+	OPERATION_BYTES(len);
+	//====== grow if required ======
+	if (sfs_file_grow_for_write(filesystem,inode,offset,len) < 0) return -1;
 	//====== do the actual writing ======
+	struct pointer_window window = POINTER_WINDOW_INIT(inode,(offset+len+SFS_PAGE_SIZE-1)/SFS_PAGE_SIZE);
 	for (uint64_t bytes_left = len; bytes_left > 0;){
 		uint64_t current_page = (offset+len-bytes_left)/SFS_PAGE_SIZE;
 		off_t page_offset = (offset+len-bytes_left)%SFS_PAGE_SIZE;
 		uint64_t bytes_to_write = MIN(SFS_PAGE_SIZE-page_offset,MIN(bytes_left,SFS_PAGE_SIZE));
-		uint64_t page = sfs_inode_get_pointer(filesystem,inode,current_page);
+		uint64_t page = pointer_window_get(filesystem,&window,current_page);
 		if (page == -1) return -1;
 		uint64_t filesystem_offset = sfs_page_offset(filesystem,page);
 		if (filesystem_offset == -1) return -1;
 		uint64_t offset = filesystem_offset+page_offset;
-		int64_t result = writeall(filesystem->filesystem_fd,buffer+len-bytes_left,bytes_to_write,offset);
+		int64_t result = writeall(filesystem,buffer+len-bytes_left,bytes_to_write,offset);
 		if (result == -1) return -1;
 		bytes_left-=bytes_to_write;
 	}
 	return len;
 }
+//====== orphans ======
+//inodes that are no longer in any directory but still hold their pages, chained from the superblock through their parent_inode_pointer
+//so that a crash part way through freeing them is finished off on the next mount
+int sfs_orphan_inode(sfs_t *filesystem,uint64_t inode){
+	OPERATION(filesystem,SFS_IO_OP_INODE_RECLAIM,"sfs_orphan_inode");
+	sfs_inode_t inode_header;
+	if (sfs_read_inode_header(filesystem,inode,&inode_header) < 0) return -1;
+	//the inode goes on the front, pointing at the old head
+	inode_header.parent_inode_pointer = filesystem->orphan_list_head;
+	if (sfs_write_inode_header(filesystem,inode,&inode_header) < 0) return -1;
+	filesystem->orphan_list_head = inode;
+	return sfs_update_superblock(filesystem);
+}
+//takes an inode off the orphan list, next_orphan being the parent_inode_pointer it was stored with
+static int unlink_orphan(sfs_t *filesystem,uint64_t inode,uint64_t next_orphan){
+	if (filesystem->orphan_list_head == inode){
+		filesystem->orphan_list_head = next_orphan;
+		return 0;
+	}
+	uint64_t orphan = filesystem->orphan_list_head;
+	for (uint64_t hops = 0; orphan != 0 && hops <= filesystem->page_count; hops++){
+		sfs_inode_t orphan_header;
+		if (sfs_read_inode_header(filesystem,orphan,&orphan_header) < 0) return -1;
+		if (orphan_header.parent_inode_pointer == inode){
+			orphan_header.parent_inode_pointer = next_orphan;
+			return sfs_write_inode_header(filesystem,orphan,&orphan_header);
+		}
+		orphan = orphan_header.parent_inode_pointer;
+	}
+	errno = ENOENT;
+	return -1;
+}
+//frees up to max_pages more of an orphan, from the end so the inode is consistent between calls
+//returns 1 once the inode page itself has gone too, 0 if there is more to free
+int sfs_reclaim_inode(sfs_t *filesystem,uint64_t inode,uint64_t max_pages){
+	OPERATION(filesystem,SFS_IO_OP_INODE_RECLAIM,"sfs_reclaim_inode");
+	if (max_pages == 0){
+		errno = EINVAL;
+		return -1;
+	}
+	sfs_inode_t inode_header;
+	if (sfs_read_inode_header(filesystem,inode,&inode_header) < 0) return -1;
+	//====== drop the last max_pages pointers ======
+	if (inode_header.pointer_count > 0){
+		uint64_t count = (inode_header.pointer_count > max_pages) ? inode_header.pointer_count-max_pages : 0;
+		//a directory points at inodes rather than data, and rmdir only orphans empty ones
+		if (truncate_pointers(filesystem,inode,count,!S_ISDIR(inode_header.mode)) < 0) return -1;
+		if (count > 0) return 0;
+	}
+	//====== nothing left but the inode page ======
+	if (unlink_orphan(filesystem,inode,inode_header.parent_inode_pointer) < 0) return -1;
+	if (sfs_free_page(filesystem,inode) < 0) return -1;
+	if (sfs_update_superblock(filesystem) < 0) return -1;
+	return 1;
+}
+//====== I/O accounting ======
+const struct sfs_io_counters *sfs_get_io_counters(sfs_t *filesystem,enum sfs_io_op op){
+	if (op >= SFS_IO_OP_COUNT){
+		errno = EINVAL;
+		return NULL;
+	}
+	return &filesystem->io_counters[op];
+}
+const char *sfs_io_op_name(enum sfs_io_op op){
+	if (op >= SFS_IO_OP_COUNT) return "unknown";
+	return io_op_names[op];
+}
+void sfs_account_file_io(sfs_t *filesystem,int writing,uint64_t logical_bytes,const struct sfs_extent extents[],size_t extent_count){
+	enum sfs_io_op op = writing ? SFS_IO_OP_FILE_WRITE : SFS_IO_OP_FILE_READ;
+	struct sfs_io_counters *counters = &filesystem->io_counters[op];
+	counters->calls++;
+	counters->logical_bytes += logical_bytes;
+	//====== the caller moved these itself, one transfer each ======
+	uint64_t done = 0;
+	for (size_t i = 0; i < extent_count && done < logical_bytes; i++){
+		uint64_t len = (extents[i].len < logical_bytes-done) ? extents[i].len : logical_bytes-done;
+		if (writing){
+			SFS_PROBE2(image__write,extents[i].image_offset,len);
+			counters->writes++;
+			counters->bytes_written += len;
+		}else{
+			SFS_PROBE2(image__read,extents[i].image_offset,len);
+			counters->reads++;
+			counters->bytes_read += len;
+		}
+		done += len;
+	}
+}
+void sfs_reset_io_counters(sfs_t *filesystem){
+	memset(filesystem->io_counters,0,sizeof(filesystem->io_counters));
+}
+int sfs_print_io_report(sfs_t *filesystem,FILE *output){
+	fprintf(output,"%-20s %10s %12s %10s %10s %10s %12s %13s %13s %17s\n","operation","calls","logical","reads","writes","seeks","bytes_read","bytes_written","phys_per_byte","syscalls_per_call");
+	for (int op = 0; op < SFS_IO_OP_COUNT; op++){
+		struct sfs_io_counters *counters = &filesystem->io_counters[op];
+		uint64_t syscalls = counters->reads+counters->writes+counters->seeks;
+		if (counters->calls == 0 && syscalls == 0) continue;
+		//====== the ratios ======
+		char bytes_ratio[32] = "-";
+		char syscall_ratio[32] = "-";
+		if (counters->logical_bytes > 0) snprintf(bytes_ratio,sizeof(bytes_ratio),"%.2f",(counters->bytes_read+counters->bytes_written)/(double)counters->logical_bytes);
+		if (counters->calls > 0) snprintf(syscall_ratio,sizeof(syscall_ratio),"%.2f",syscalls/(double)counters->calls);
+		int result = fprintf(output,"%-20s %10lu %12lu %10lu %10lu %10lu %12lu %13lu %13s %17s\n",
+			io_op_names[op],
+			counters->calls,
+			counters->logical_bytes,
+			counters->reads,
+			counters->writes,
+			counters->seeks,
+			counters->bytes_read,
+			counters->bytes_written,
+			bytes_ratio,
+			syscall_ratio
+		);
+		if (result < 0) return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,103 @@
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include "libslab.h"
+
+//====== static functions ======
+static int _slab_add_chunk(SLAB *slab){
+	struct slab_chunk *chunk = malloc(sizeof(struct slab_chunk));
+	if (chunk == NULL) return -1;
+	chunk->memory = aligned_alloc(slab->alignment,slab->object_size*slab->objects_per_chunk);
+	if (chunk->memory == NULL){
+		free(chunk);
+		return -1;
+	}
+	//never used objects start out zeroed
+	memset(chunk->memory,0,slab->object_size*slab->objects_per_chunk);
+	chunk->next = slab->chunks;
+	slab->chunks = chunk;
+	slab->chunk_objects_used = 0;
+	return 0;
+}
+
+//====== exported functions ======
+SLAB *slab_new(size_t object_size,size_t alignment,size_t objects_per_chunk){
+	//alignment has to fit the free list pointer and be a power of 2
+	if (alignment < sizeof(void *)) alignment = sizeof(void *);
+	if ((alignment & (alignment-1)) != 0 || objects_per_chunk == 0){
+		errno = EINVAL;
+		return NULL;
+	}
+	SLAB *slab = malloc(sizeof(SLAB));
+	if (slab == NULL) return NULL;
+	memset(slab,0,sizeof(SLAB));
+	//round up so every object in a chunk stays aligned (this also makes room for the free list pointer)
+	slab->object_size = (object_size+alignment-1) & ~(alignment-1);
+	slab->alignment = alignment;
+	slab->objects_per_chunk = objects_per_chunk;
+	slab->free_list = NULL;
+	slab->chunks = NULL;
+	return slab;
+}
+void slab_delete(SLAB *slab){
+	for (struct slab_chunk *chunk = slab->chunks; chunk != NULL;){
+		struct slab_chunk *next = chunk->next;
+		free(chunk->memory);
+		free(chunk);
+		chunk = next;
+	}
+	free(slab);
+}
+void *slab_alloc(SLAB *slab){
+	//====== reuse a freed object if there is one ======
+	if (slab->free_list != NULL){
+		void *object = slab->free_list;
+		memcpy(&slab->free_list,object,sizeof(void *));
+		return object;
+	}
+	//====== otherwise carve one out of the newest chunk ======
+	if (slab->chunks == NULL || slab->chunk_objects_used == slab->objects_per_chunk){
+		if (_slab_add_chunk(slab) < 0){
+			errno = ENOMEM;
+			return NULL;
+		}
+	}
+	void *object = (char *)slab->chunks->memory+(slab->object_size*slab->chunk_objects_used);
+	slab->chunk_objects_used++;
+	return object;
+}
+void slab_free(SLAB *slab,void *object){
+	if (object == NULL) return;
+	memcpy(object,&slab->free_list,sizeof(void *));
+	slab->free_list = object;
+}
+void slab_foreach_free(SLAB *slab,void (*func)(void *,void *),void *user_data){
+	for (void *object = slab->free_list; object != NULL;){
+		void *next;
+		memcpy(&next,object,sizeof(void *));
+		func(object,user_data);
+		object = next;
+	}
+}
+int slab_buffer_reserve(struct slab_buffer *buffer,size_t size){
+	if (size <= buffer->size) return 0;
+	//grow to the next power of 2 so a slowly growing size doesnt reallocate every time
+	size_t new_size = (buffer->size == 0) ? 4096 : buffer->size;
+	for (;new_size < size;) new_size *= 2;
+	void *new_data;
+	int result = posix_memalign(&new_data,sysconf(_SC_PAGESIZE),new_size);
+	if (result != 0){
+		errno = result;
+		return -1;
+	}
+	free(buffer->data);
+	buffer->data = new_data;
+	buffer->size = new_size;
+	return 0;
+}
+void slab_buffer_free(struct slab_buffer *buffer){
+	free(buffer->data);
+	buffer->data = NULL;
+	buffer->size = 0;
+}
@@ -0,0 +1,42 @@
+#ifndef _LIBSLAB_H
+#define _LIBSLAB_H
+
+#include <stddef.h>
+
+//====== types ======
+struct slab_chunk {
+	struct slab_chunk *next;
+	void *memory;
+};
+struct slab {
+	size_t object_size; //rounded up to the alignment
+	size_t alignment;
+	size_t objects_per_chunk;
+	void *free_list; //freed objects, each one holds a pointer to the next in its first bytes
+	struct slab_chunk *chunks;
+	size_t chunk_objects_used; //objects handed out from the newest chunk so far
+};
+typedef struct slab SLAB;
+
+//a buffer that is reused between calls and only ever grows
+struct slab_buffer {
+	void *data;
+	size_t size;
+};
+
+//====== functions ======
+SLAB *slab_new(size_t object_size,size_t alignment,size_t objects_per_chunk);
+//frees every chunk, including any objects still allocated
+void slab_delete(SLAB *slab);
+//returns NULL with errno set to ENOMEM on failure. objects that have never been handed out before are zeroed
+void *slab_alloc(SLAB *slab);
+//the first sizeof(void *) bytes of the object are overwritten, the rest is left as it was
+void slab_free(SLAB *slab,void *object);
+//calls func on every object that has been freed back to the slab (but not handed out again)
+void slab_foreach_free(SLAB *slab,void (*func)(void *,void *),void *user_data);
+
+//makes sure the buffer can hold size bytes, growing it page aligned if needed. contents are not kept
+int slab_buffer_reserve(struct slab_buffer *buffer,size_t size);
+void slab_buffer_free(struct slab_buffer *buffer);
+
+#endif
@@ -0,0 +1,34 @@
+#include <stdio.h>
+#include <assert.h>
+#include <stdint.h>
+#include "libslab.h"
+
+void count_free(void *object,void *user_data){
+	(*(int *)user_data)++;
+}
+int main(){
+	SLAB *slab = slab_new(24,64,4);
+	void *objects[10];
+	for (int i = 0; i < 10; i++){
+		objects[i] = slab_alloc(slab);
+		assert(((uintptr_t)objects[i] % 64) == 0);
+		printf("%p\n",objects[i]);
+	}
+	for (int i = 0; i < 10; i++){
+		slab_free(slab,objects[i]);
+	}
+	int free_count = 0;
+	slab_foreach_free(slab,count_free,&free_count);
+	printf("%d free\n",free_count);
+	//freed objects are handed out again before any new chunk is made
+	for (int i = 9; i >= 0; i--){
+		assert(slab_alloc(slab) == objects[i]);
+	}
+	slab_delete(slab);
+
+	struct slab_buffer buffer = {0};
+	assert(slab_buffer_reserve(&buffer,100) == 0);
+	assert(slab_buffer_reserve(&buffer,5000) == 0);
+	printf("buffer size %zu\n",buffer.size);
+	slab_buffer_free(&buffer);
+}
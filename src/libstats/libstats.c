@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include "libstats.h"
+
+//====== types ======
+struct stats_counter {
+	uint64_t count;
+	uint64_t bytes;
+	uint64_t total_ns;
+	uint64_t buckets[STATS_BUCKETS];
+};
+//each thread only ever writes its own counters, so recording needs no locks
+//(readers may see a call half counted, which is fine for statistics)
+struct stats_thread {
+	struct stats_thread *next;
+	struct stats_counter counters[STATS_MAX_OPS];
+};
+
+//====== globals ======
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER; //guards registering names and the thread list
+static char op_names[STATS_MAX_OPS][STATS_MAX_NAME];
+static int op_count = 0;
+static struct stats_thread *thread_list = NULL;
+static _Thread_local struct stats_thread *current_thread = NULL;
+
+//====== static functions ======
+static struct stats_thread *_get_thread(){
+	if (current_thread != NULL) return current_thread;
+	struct stats_thread *thread = calloc(1,sizeof(struct stats_thread));
+	if (thread == NULL) return NULL;
+	//kept after the thread exits so its calls are still counted
+	pthread_mutex_lock(&stats_lock);
+	thread->next = thread_list;
+	thread_list = thread;
+	pthread_mutex_unlock(&stats_lock);
+	current_thread = thread;
+	return thread;
+}
+static int _bucket(uint64_t elapsed_ns){
+	if (elapsed_ns < 2) return 0;
+	return 63-__builtin_clzll(elapsed_ns);
+}
+static void _add(uint64_t *counter,uint64_t value){
+	__atomic_store_n(counter,__atomic_load_n(counter,__ATOMIC_RELAXED)+value,__ATOMIC_RELAXED);
+}
+static uint64_t _percentile(uint64_t buckets[STATS_BUCKETS],uint64_t count,double fraction){
+	//the rank of the call that the percentile lands on
+	uint64_t rank = (uint64_t)(count*fraction);
+	if (rank >= count) rank = count-1;
+	uint64_t seen = 0;
+	for (int i = 0; i < STATS_BUCKETS; i++){
+		seen += buckets[i];
+		if (seen > rank) return (i == 63) ? UINT64_MAX : ((uint64_t)2 << i);
+	}
+	return 0;
+}
+
+//====== exported functions ======
+uint64_t stats_now(){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return (uint64_t)now.tv_sec*1000000000+now.tv_nsec;
+}
+int stats_register(const char *name){
+	pthread_mutex_lock(&stats_lock);
+	int id = -1;
+	for (int i = 0; i < op_count; i++){
+		if (strcmp(op_names[i],name) == 0){
+			id = i;
+			break;
+		}
+	}
+	if (id == -1 && op_count < STATS_MAX_OPS){
+		id = op_count;
+		strncpy(op_names[id],name,STATS_MAX_NAME-1);
+		__atomic_store_n(&op_count,op_count+1,__ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&stats_lock);
+	return id;
+}
+void stats_record(int op,uint64_t elapsed_ns,uint64_t bytes){
+	if (op < 0 || op >= STATS_MAX_OPS) return;
+	struct stats_thread *thread = _get_thread();
+	if (thread == NULL) return;
+	struct stats_counter *counter = &thread->counters[op];
+	_add(&counter->count,1);
+	_add(&counter->bytes,bytes);
+	_add(&counter->total_ns,elapsed_ns);
+	_add(&counter->buckets[_bucket(elapsed_ns)],1);
+}
+void stats_timer_end(struct stats_timer *timer){
+	stats_record(timer->op,stats_now()-timer->start,timer->bytes);
+}
+int stats_summarise(struct stats_summary summaries[],int max){
+	int filled = 0;
+	int registered = __atomic_load_n(&op_count,__ATOMIC_ACQUIRE);
+	pthread_mutex_lock(&stats_lock);
+	for (int op = 0; op < registered && filled < max; op++){
+		//====== add up every thread ======
+		struct stats_counter total;
+		memset(&total,0,sizeof(struct stats_counter));
+		for (struct stats_thread *thread = thread_list; thread != NULL; thread = thread->next){
+			struct stats_counter *counter = &thread->counters[op];
+			total.count += __atomic_load_n(&counter->count,__ATOMIC_RELAXED);
+			total.bytes += __atomic_load_n(&counter->bytes,__ATOMIC_RELAXED);
+			total.total_ns += __atomic_load_n(&counter->total_ns,__ATOMIC_RELAXED);
+			for (int i = 0; i < STATS_BUCKETS; i++){
+				total.buckets[i] += __atomic_load_n(&counter->buckets[i],__ATOMIC_RELAXED);
+			}
+		}
+		if (total.count == 0) continue;
+		//====== summarise ======
+		//use the bucket total rather than count as a call being recorded right now may only be half added
+		uint64_t bucket_total = 0;
+		for (int i = 0; i < STATS_BUCKETS; i++) bucket_total += total.buckets[i];
+		struct stats_summary *summary = &summaries[filled];
+		memcpy(summary->name,op_names[op],STATS_MAX_NAME);
+		summary->count = total.count;
+		summary->bytes = total.bytes;
+		summary->total_ns = total.total_ns;
+		summary->p50_ns = _percentile(total.buckets,bucket_total,0.5);
+		summary->p99_ns = _percentile(total.buckets,bucket_total,0.99);
+		summary->p999_ns = _percentile(total.buckets,bucket_total,0.999);
+		filled++;
+	}
+	pthread_mutex_unlock(&stats_lock);
+	return filled;
+}
+char *stats_format(size_t *size_return){
+	struct stats_summary summaries[STATS_MAX_OPS];
+	int count = stats_summarise(summaries,STATS_MAX_OPS);
+	//====== write the table ======
+	char *buffer;
+	size_t size;
+	FILE *output = open_memstream(&buffer,&size);
+	if (output == NULL) return NULL;
+	fprintf(output,"%-24s %12s %14s %10s %10s %10s %10s\n","operation","count","bytes","mean_us","p50_us","p99_us","p999_us");
+	for (int i = 0; i < count; i++){
+		struct stats_summary *summary = &summaries[i];
+		fprintf(output,"%-24s %12lu %14lu %10.1f %10.1f %10.1f %10.1f\n",
+			summary->name,
+			summary->count,
+			summary->bytes,
+			summary->total_ns/(double)summary->count/1000.0,
+			summary->p50_ns/1000.0,
+			summary->p99_ns/1000.0,
+			summary->p999_ns/1000.0
+		);
+	}
+	if (fclose(output) != 0){
+		free(buffer);
+		return NULL;
+	}
+	if (size_return != NULL) *size_return = size;
+	return buffer;
+}
+void stats_cleanup(){
+	pthread_mutex_lock(&stats_lock);
+	for (struct stats_thread *thread = thread_list; thread != NULL;){
+		struct stats_thread *next = thread->next;
+		free(thread);
+		thread = next;
+	}
+	thread_list = NULL;
+	pthread_mutex_unlock(&stats_lock);
+	//any thread still holding one of the freed blocks must not use it again
+	current_thread = NULL;
+}
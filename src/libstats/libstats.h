@@ -0,0 +1,63 @@
+#ifndef _LIBSTATS_H
+#define _LIBSTATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define STATS_MAX_OPS 64
+//bucket n holds latencies of [2^n,2^(n+1)) nanoseconds
+#define STATS_BUCKETS 64
+#define STATS_MAX_NAME 32
+
+//====== types ======
+struct stats_timer {
+	int op;
+	uint64_t start;
+	uint64_t bytes;
+};
+struct stats_summary {
+	char name[STATS_MAX_NAME];
+	uint64_t count;
+	uint64_t bytes;
+	uint64_t total_ns;
+	//upper bound of the bucket each percentile falls in
+	uint64_t p50_ns;
+	uint64_t p99_ns;
+	uint64_t p999_ns;
+};
+
+//====== functions ======
+uint64_t stats_now();
+//returns the id for the named operation, registering it the first time. -1 if STATS_MAX_OPS are already in use
+int stats_register(const char *name);
+//adds one call to the calling thread's counters, never blocks
+void stats_record(int op,uint64_t elapsed_ns,uint64_t bytes);
+void stats_timer_end(struct stats_timer *timer);
+//fills in the totals of every thread for each registered operation (that has been called), returns how many were filled
+int stats_summarise(struct stats_summary summaries[],int max);
+//a human readable table of stats_summarise, malloced. NULL on failure
+char *stats_format(size_t *size_return);
+//frees every thread's counters, only call once nothing else will record
+void stats_cleanup();
+
+//caches the id in *id so registering only happens on the first call
+static inline int stats_op_id(int *id,const char *name){
+	int value = __atomic_load_n(id,__ATOMIC_ACQUIRE);
+	if (value < 0){
+		value = stats_register(name);
+		__atomic_store_n(id,value,__ATOMIC_RELEASE);
+	}
+	return value;
+}
+
+//====== macros ======
+//times from here until the enclosing scope is left (by any return), recording it under name
+//only use once per scope
+#define STATS_SCOPE(name) \
+	static int _stats_op_id = -1; \
+	struct stats_timer _stats_timer __attribute__((cleanup(stats_timer_end))) = {.op = stats_op_id(&_stats_op_id,(name)),.start = stats_now(),.bytes = 0}
+//sets the byte count recorded when the scope is left
+#define STATS_BYTES(count) (_stats_timer.bytes = (count))
+
+#endif
@@ -0,0 +1,39 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "libstats.h"
+
+void timed_function(int sleep_us){
+	STATS_SCOPE("timed_function");
+	STATS_BYTES(100);
+	if (sleep_us == 0) return;
+	usleep(sleep_us);
+}
+void *worker(void *){
+	for (int i = 0; i < 100; i++) timed_function(0);
+	return NULL;
+}
+int main(){
+	assert(stats_register("first") == 0);
+	assert(stats_register("first") == 0);
+	for (int i = 0; i < 1000; i++) stats_record(0,i*1000,1);
+	pthread_t threads[4];
+	for (int i = 0; i < 4; i++) pthread_create(&threads[i],NULL,worker,NULL);
+	for (int i = 0; i < 4; i++) pthread_join(threads[i],NULL);
+	timed_function(1000);
+
+	struct stats_summary summaries[STATS_MAX_OPS];
+	int count = stats_summarise(summaries,STATS_MAX_OPS);
+	assert(count == 2);
+	assert(summaries[0].count == 1000);
+	//500us lands in the [262144,524288) bucket
+	assert(summaries[0].p50_ns == 524288);
+	assert(summaries[1].count == 401);
+	assert(summaries[1].bytes == 40100);
+	char *table = stats_format(NULL);
+	printf("%s",table);
+	free(table);
+	stats_cleanup();
+}
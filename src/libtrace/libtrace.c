@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include "libtrace.h"
+
+#define TRACE_BUFFER_SIZE (1024*1024)
+
+//====== globals ======
+static const char *op_names[TRACE_OP_COUNT] = {
+	[TRACE_OP_NONE] = "none",
+	[TRACE_OP_LOOKUP] = "lookup",
+	[TRACE_OP_FORGET] = "forget",
+	[TRACE_OP_GETATTR] = "getattr",
+	[TRACE_OP_SETATTR] = "setattr",
+	[TRACE_OP_ACCESS] = "access",
+	[TRACE_OP_MKNOD] = "mknod",
+	[TRACE_OP_MKDIR] = "mkdir",
+	[TRACE_OP_UNLINK] = "unlink",
+	[TRACE_OP_RMDIR] = "rmdir",
+	[TRACE_OP_OPEN] = "open",
+	[TRACE_OP_READ] = "read",
+	[TRACE_OP_WRITE] = "write",
+	[TRACE_OP_RELEASE] = "release",
+	[TRACE_OP_OPENDIR] = "opendir",
+	[TRACE_OP_READDIR] = "readdir",
+	[TRACE_OP_READDIRPLUS] = "readdirplus",
+	[TRACE_OP_RELEASEDIR] = "releasedir",
+	[TRACE_OP_RENAME] = "rename",
+};
+
+//====== static functions ======
+static uint64_t _clock_ns(clockid_t clock){
+	struct timespec now;
+	clock_gettime(clock,&now);
+	return (uint64_t)now.tv_sec*1000000000+now.tv_nsec;
+}
+static TRACE *_new(const char *path,const char *mode,int writing){
+	TRACE *trace = malloc(sizeof(TRACE));
+	if (trace == NULL) return NULL;
+	trace->file = fopen(path,mode);
+	if (trace->file == NULL){
+		free(trace);
+		return NULL;
+	}
+	//requests arrive far faster than it is worth writing them one by one
+	setvbuf(trace->file,NULL,_IOFBF,TRACE_BUFFER_SIZE);
+	trace->writing = writing;
+	trace->start = _clock_ns(CLOCK_MONOTONIC);
+	pthread_mutex_init(&trace->lock,NULL);
+	return trace;
+}
+
+//====== exported functions ======
+TRACE *trace_create(const char *path){
+	TRACE *trace = _new(path,"w",1);
+	if (trace == NULL) return NULL;
+	struct trace_header header = {
+		.magic = TRACE_MAGIC,
+		.version = TRACE_VERSION,
+		.start_time = _clock_ns(CLOCK_REALTIME),
+	};
+	if (fwrite(&header,sizeof(header),1,trace->file) != 1){
+		int error = errno;
+		trace_close(trace);
+		errno = error;
+		return NULL;
+	}
+	return trace;
+}
+TRACE *trace_open(const char *path){
+	TRACE *trace = _new(path,"r",0);
+	if (trace == NULL) return NULL;
+	struct trace_header header;
+	if (fread(&header,sizeof(header),1,trace->file) != 1 || header.magic != TRACE_MAGIC || header.version != TRACE_VERSION){
+		trace_close(trace);
+		errno = EINVAL;
+		return NULL;
+	}
+	return trace;
+}
+uint64_t trace_now(TRACE *trace){
+	return _clock_ns(CLOCK_MONOTONIC)-trace->start;
+}
+int trace_write(TRACE *trace,struct trace_record *record,const char *name){
+	size_t name_length = (name == NULL) ? 0 : strnlen(name,TRACE_MAX_NAME-1);
+	record->name_length = name_length;
+	pthread_mutex_lock(&trace->lock);
+	int result = 0;
+	if (fwrite(record,sizeof(struct trace_record),1,trace->file) != 1) result = -1;
+	else if (name_length > 0 && fwrite(name,name_length,1,trace->file) != 1) result = -1;
+	pthread_mutex_unlock(&trace->lock);
+	return result;
+}
+int trace_read(TRACE *trace,struct trace_record *record,char name[TRACE_MAX_NAME]){
+	if (fread(record,sizeof(struct trace_record),1,trace->file) != 1){
+		if (feof(trace->file)) return 0;
+		return -1;
+	}
+	//a record cut off part way (e.g. mountsfs was killed) ends the trace
+	if (record->name_length >= TRACE_MAX_NAME){
+		errno = EINVAL;
+		return -1;
+	}
+	if (record->name_length > 0 && fread(name,record->name_length,1,trace->file) != 1) return 0;
+	name[record->name_length] = '\0';
+	return 1;
+}
+int trace_close(TRACE *trace){
+	int result = fclose(trace->file);
+	pthread_mutex_destroy(&trace->lock);
+	free(trace);
+	return result;
+}
+const char *trace_op_name(int op){
+	if (op < 0 || op >= TRACE_OP_COUNT) return "unknown";
+	return op_names[op];
+}
@@ -0,0 +1,79 @@
+#ifndef _LIBTRACE_H
+#define _LIBTRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+//a trace is a header followed by records, each record is a struct trace_record then name_length bytes of name (no null)
+//everything is in the byte order of the machine that wrote it, the magic number catches a mismatch
+#define TRACE_MAGIC 0x53465354 //SFST
+#define TRACE_VERSION 2 //2 added rename and names of up to TRACE_MAX_NAME-1 = 511 bytes
+#define TRACE_MAX_NAME 512 //room for a rename's old/new
+
+//====== types ======
+//one per fuse request type
+enum trace_op {
+	TRACE_OP_NONE,
+	TRACE_OP_LOOKUP,
+	TRACE_OP_FORGET,
+	TRACE_OP_GETATTR,
+	TRACE_OP_SETATTR,
+	TRACE_OP_ACCESS,
+	TRACE_OP_MKNOD,
+	TRACE_OP_MKDIR,
+	TRACE_OP_UNLINK,
+	TRACE_OP_RMDIR,
+	TRACE_OP_OPEN,
+	TRACE_OP_READ,
+	TRACE_OP_WRITE,
+	TRACE_OP_RELEASE,
+	TRACE_OP_OPENDIR,
+	TRACE_OP_READDIR,
+	TRACE_OP_READDIRPLUS,
+	TRACE_OP_RELEASEDIR,
+	TRACE_OP_RENAME,
+	TRACE_OP_COUNT
+};
+struct trace_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t start_time; //wall clock time the trace started, in ns since the epoch
+};
+//fields an op has no use for are left as 0
+struct trace_record {
+	uint8_t op;
+	uint8_t unused;
+	uint16_t name_length;
+	uint32_t flags; //open flags, the setattr to_set mask, the access mask or the rename flags
+	uint32_t mode; //mkdir, mknod and setattr
+	uint32_t unused2;
+	uint64_t start_ns; //since the trace started
+	uint64_t duration_ns;
+	uint64_t inode; //the parent for ops taking a name
+	uint64_t offset; //the new parent for rename
+	uint64_t size; //bytes asked for, the new size for setattr or the lookup count for forget
+	uint64_t result; //inode found or created, or bytes read / written
+};
+struct trace {
+	FILE *file;
+	int writing;
+	uint64_t start; //CLOCK_MONOTONIC when the trace was created
+	pthread_mutex_t lock; //records can come from any thread
+};
+typedef struct trace TRACE;
+
+//====== functions ======
+//both return NULL with errno set on failure
+TRACE *trace_create(const char *path);
+TRACE *trace_open(const char *path);
+//ns since the trace was created, for filling in start_ns
+uint64_t trace_now(TRACE *trace);
+//name may be NULL. records are buffered so they may not reach the file until trace_close
+int trace_write(TRACE *trace,struct trace_record *record,const char *name);
+//fills in the next record and its null terminated name, returns 1 for a record, 0 at the end of the trace or -1 on error
+int trace_read(TRACE *trace,struct trace_record *record,char name[TRACE_MAX_NAME]);
+int trace_close(TRACE *trace);
+const char *trace_op_name(int op);
+
+#endif
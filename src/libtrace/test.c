@@ -0,0 +1,43 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include "libtrace.h"
+
+int main(){
+	TRACE *trace = trace_create("test.trace");
+	assert(trace != NULL);
+	for (int i = 0; i < 1000; i++){
+		struct trace_record record = {
+			.op = TRACE_OP_WRITE,
+			.start_ns = trace_now(trace),
+			.inode = i,
+			.offset = i*4096,
+			.size = 4096,
+		};
+		assert(trace_write(trace,&record,(i % 2) ? "file" : NULL) == 0);
+	}
+	assert(trace_close(trace) == 0);
+
+	trace = trace_open("test.trace");
+	assert(trace != NULL);
+	struct trace_record record;
+	char name[TRACE_MAX_NAME];
+	int count = 0;
+	uint64_t last_start = 0;
+	while (trace_read(trace,&record,name) == 1){
+		assert(record.op == TRACE_OP_WRITE);
+		assert(record.inode == count);
+		assert(record.offset == count*4096);
+		assert(record.start_ns >= last_start);
+		assert(strcmp(name,(count % 2) ? "file" : "") == 0);
+		last_start = record.start_ns;
+		count++;
+	}
+	assert(count == 1000);
+	assert(trace_close(trace) == 0);
+	printf("%s ok\n",trace_op_name(TRACE_OP_WRITE));
+	unlink("test.trace");
+	//not a trace
+	assert(trace_open("test.c") == NULL);
+}
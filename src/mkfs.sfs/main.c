@@ -2,76 +2,94 @@
 #include "../../include/sfs_types.h"
 
 #include <stdio.h>
-#include <assert.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#define DEFAULT_SIZE "4M"
+
+static void show_usage(char *name);
+int parse_size(const char *string,uint64_t *size_return);
 
 int main(int argc, char **argv){
-	if (argc != 2){
-		printf("usage: %s <file>\n",argv[0]);
+	static struct option long_options[] = {
+		{"size",	required_argument,	0,'s'},
+		{"fallocate",	no_argument,		0,'f'},
+		{"help",	no_argument,		0,'h'},
+		{0,		0,			0,0}
+	};
+	const char *size_string = NULL;
+	int flags = 0;
+	for (;;){
+		int option_index = 0;
+		int result = getopt_long(argc,argv,"s:fh",long_options,&option_index);
+		if (result == -1) break;
+		switch (result){
+			case 's':
+				size_string = optarg;
+				break;
+			case 'f':
+				flags |= SFS_FUNC_FLAG_FALLOCATE;
+				break;
+			case 'h':
+				show_usage(argv[0]);
+				return 0;
+			default:
+				show_usage(argv[0]);
+				return 1;
+		}
+	}
+	if (argc-optind != 1){
+		show_usage(argv[0]);
 		return 1;
 	}
-	uint64_t pages_to_create = 4096/**1024*/;
+	//a block device is filled unless told otherwise
+	struct stat statbuf;
+	int block_device = (stat(argv[optind],&statbuf) == 0 && S_ISBLK(statbuf.st_mode));
+	if (size_string == NULL && !block_device) size_string = DEFAULT_SIZE;
+	uint64_t page_count = 0;
+	if (size_string != NULL){
+		uint64_t size;
+		if (parse_size(size_string,&size) != 0 || size/SFS_PAGE_SIZE < 2){
+			fprintf(stderr,"size must be at least %dK, with an optional K, M, G or T suffix\n",2*SFS_PAGE_SIZE/1024);
+			return 1;
+		}
+		page_count = size/SFS_PAGE_SIZE;
+	}
+
+	//====== format ======
 	sfs_t filesystem;
-	int result = sfs_open_fs(&filesystem,argv[1],SFS_FUNC_FLAG_SKIP_SUPERBLOCK_CHECK | SFS_FUNC_FLAG_O_CREATE);
-	if (result < 0){
-		perror("sfs_open_fs");
+	if (sfs_create_fs(&filesystem,argv[optind],page_count,flags) != 0){
+		fprintf(stderr,"could not create %s: %s\n",argv[optind],strerror(errno));
 		return 1;
 	}
-	filesystem.first_free_page_index = (uint64_t)-1;
-	filesystem.page_count = pages_to_create;
-	filesystem.current_generation_number = 1;
-	sfs_update_superblock(&filesystem);
-
-	//====== create the root inode ======
-	sfs_inode_t root_inode = {
-		.mode = S_IFDIR | 0755,
-		.uid = getuid(),
-		.gid = getgid(),
-		.page = 1,
-		.parent_inode_pointer = 1,
-		.pointer_count = 0,
-		.next_page = (uint64_t)-1,
-		.previous_page = (uint64_t)-1,
-		.name = {"/"},
-		.generation_number = 0
-	};
-	sfs_write_inode_header(&filesystem,1,&root_inode);
-
-	//====== generate empty pages of the requested amount ======
-	for (uint64_t i = 2; i < pages_to_create; i++){
-		sfs_free_page(&filesystem,i);
+	page_count = filesystem.page_count;
+	if (sfs_close_fs(&filesystem,0) != 0){
+		perror("sfs_close_fs");
+		return 1;
 	}
-
-	/* testing --- testing --- testing --- testing --- */
-	char name[256] = "epic-bacon";
-	uint64_t p1 = sfs_inode_create(&filesystem,name,S_IFDIR | 0755,getuid(),getgid(),1);
-	assert(p1 != (uint64_t)-1);
-	strcpy(name,"a");
-	assert(sfs_inode_create(&filesystem,name,S_IFDIR | 0755,getuid(),getgid(),1) != (uint64_t)-1);
-	strcpy(name,"b");
-	assert(sfs_inode_create(&filesystem,name,S_IFDIR | 0755,getuid(),getgid(),1) != (uint64_t)-1);
-	strcpy(name,"c");
-	assert(sfs_inode_create(&filesystem,name,S_IFDIR | 0755,getuid(),getgid(),1) != (uint64_t)-1);
-	/*
-	sfs_inode_t root_page;
-	assert(sfs_read_inode_header(&filesystem,1,&root_page) == 0);
-	assert(sfs_inode_realocate_pointers(&filesystem,1,5) == 0);
-	assert(sfs_read_inode_header(&filesystem,1,&root_page) == 0);
-
-	assert(sfs_inode_set_pointer(&filesystem,1,0,101) == 0);
-	assert(sfs_inode_set_pointer(&filesystem,1,1,102) == 0);
-	assert(sfs_inode_set_pointer(&filesystem,1,2,103) == 0);
-	assert(sfs_inode_set_pointer(&filesystem,1,3,104) == 0);
-	assert(sfs_inode_set_pointer(&filesystem,1,4,105) == 0);
-	assert(sfs_inode_remove_pointer(&filesystem,1,2) == 0);
-	//assert(sfs_read_inode_header(&filesystem,1,&root_page) == 0);
-	printf("%lu\n",sfs_inode_get_pointer(&filesystem,1,0));
-	printf("%lu\n",sfs_inode_get_pointer(&filesystem,1,1));
-	printf("%lu\n",sfs_inode_get_pointer(&filesystem,1,2));
-	printf("%lu\n",sfs_inode_get_pointer(&filesystem,1,3));
-	printf("%lu\n",sfs_inode_get_pointer(&filesystem,1,4));
-	*/
-	sfs_close_fs(&filesystem,0);
+	printf("%s: %lu pages of %d bytes\n",argv[optind],page_count,SFS_PAGE_SIZE);
+	return 0;
+}
+static void show_usage(char *name){
+	printf("usage: %s [options] <file>\n",name);
+	printf(" -s / --size <size> : size of the filesystem with an optional K, M, G or T suffix (default %s, or all of a block device)\n",DEFAULT_SIZE);
+	printf(" -f / --fallocate : reserve the whole image on disk up front\n");
+}
+int parse_size(const char *string,uint64_t *size_return){
+	char *end;
+	unsigned long long size = strtoull(string,&end,10);
+	if (end == string) return -1;
+	switch (*end){
+		case 't': case 'T': size *= 1024; //fall through
+		case 'g': case 'G': size *= 1024; //fall through
+		case 'm': case 'M': size *= 1024; //fall through
+		case 'k': case 'K': size *= 1024; end++; break;
+	}
+	if (*end != '\0') return -1;
+	*size_return = size;
 	return 0;
 }
@@ -2,6 +2,12 @@
 #include "../../include/sfs_functions.h"
 #include "../libbst/libbst.h"
 #include "../libtable/libtable.h"
+#include "../liblog/liblog.h"
+#include "../libslab/libslab.h"
+#include "../libstats/libstats.h"
+#include "../libtrace/libtrace.h"
+#include "../libdcache/libdcache.h"
+#include "../../include/sfs_probes.h"
 
 #define FUSE_USE_VERSION 34
 
@@ -13,16 +19,69 @@
 #include <string.h>
 #include <getopt.h>
 #include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
 
 #define FUSE_ROOT_INODE 1
 
 #define MAX_OPEN_DIRS 1024
 #define MAX_OPEN_FILES 1024
+//how long the reclaim thread stays off the filesystem between batches
+#define RECLAIM_PAUSE_NS 1000000
+
+//hidden read only file at the root showing the latency stats
+//inode numbers are page indexes so this one can never clash with a real inode
+#define STATS_INODE ((fuse_ino_t)-2)
+#define STATS_FILE_NAME ".sfs_stats"
+
+//renameat2 flags, which not every libc defines
+#ifndef RENAME_NOREPLACE
+#define RENAME_NOREPLACE (1 << 0)
+#endif
+#ifndef RENAME_EXCHANGE
+#define RENAME_EXCHANGE (1 << 1)
+#endif
+
+//====== per request instrumentation ======
+//goes at the top of every handler: times it into the stats, fires the sfs:handler__entry / sfs:handler__exit probes,
+//holds the filesystem lock until the handler returns (the reclaim thread shares the filesystem)
+//and when -o trace=FILE was given records the request (handlers fill in the rest of the record with HANDLER_TRACE)
+struct handler_scope {
+	const char *name;
+	uint64_t inode;
+	const char *trace_name;
+	struct trace_record record;
+};
+extern TRACE *request_trace;
+extern pthread_mutex_t filesystem_lock;
+static inline void handler_scope_exit(struct handler_scope *scope){
+	pthread_mutex_unlock(&filesystem_lock);
+	SFS_PROBE2(handler__exit,scope->name,scope->inode);
+	if (request_trace != NULL){
+		scope->record.duration_ns = trace_now(request_trace)-scope->record.start_ns;
+		trace_write(request_trace,&scope->record,scope->trace_name);
+	}
+}
+#define HANDLER_SCOPE(handler_op,handler_inode) \
+	STATS_SCOPE(trace_op_name(handler_op)); \
+	SFS_PROBE2(handler__entry,trace_op_name(handler_op),(uint64_t)(handler_inode)); \
+	pthread_mutex_lock(&filesystem_lock); \
+	struct handler_scope _handler_scope __attribute__((cleanup(handler_scope_exit))) = { \
+		.name = trace_op_name(handler_op), \
+		.inode = (handler_inode), \
+		.record = {.op = (handler_op),.inode = (handler_inode),.start_ns = (request_trace != NULL) ? trace_now(request_trace) : 0}, \
+	}
+//sets a field of this request's trace record
+#define HANDLER_TRACE(field,value) (_handler_scope.record.field = (value))
+#define HANDLER_TRACE_NAME(value) (_handler_scope.trace_name = (value))
 
 //====== miscelanious prototypes ======
+static void sfs_init(void *userdata,struct fuse_conn_info *connection);
 static int sfs_stat(fuse_ino_t ino, struct stat *statbuf);
 static void sfs_opendir(fuse_req_t request,fuse_ino_t ino,struct fuse_file_info *file_info);
 static void sfs_readdir(fuse_req_t request,fuse_ino_t ino,size_t size,off_t offset,struct fuse_file_info *file_info);
+static void sfs_readdirplus(fuse_req_t request,fuse_ino_t ino,size_t size,off_t offset,struct fuse_file_info *file_info);
 static void sfs_releasedir(fuse_req_t request,fuse_ino_t ino,struct fuse_file_info *file_info);
 static void sfs_getattr(fuse_req_t request,fuse_ino_t ino,struct fuse_file_info *file_info);
 static void sfs_lookup(fuse_req_t request,fuse_ino_t parent,const char *name);
@@ -33,29 +92,61 @@ static void show_usage(char *name);
 static void sfs_mknod(fuse_req_t request, fuse_ino_t parent, const char *name, mode_t mode, dev_t rdev);
 static void sfs_setattr(fuse_req_t request,fuse_ino_t ino,struct stat *attr,int to_set,struct fuse_file_info *fi);
 static void sfs_unlink(fuse_req_t request,fuse_ino_t parent,const char *name);
+static void sfs_rename(fuse_req_t request,fuse_ino_t parent,const char *name,fuse_ino_t newparent,const char *newname,unsigned int flags);
 static void sfs_open(fuse_req_t request,fuse_ino_t ino, struct fuse_file_info *fi);
 static void sfs_release(fuse_req_t request,fuse_ino_t ino, struct fuse_file_info *fi);
 static void sfs_read(fuse_req_t request,fuse_ino_t ino,size_t size,off_t off,struct fuse_file_info *fi);
-static void sfs_write(fuse_req_t request,fuse_ino_t ino,const char *buffer,size_t size,off_t off,struct fuse_file_info *fi);
+static void sfs_write_buf(fuse_req_t request,fuse_ino_t ino,struct fuse_bufvec *in_buffers,off_t offset,struct fuse_file_info *fi);
 static void sfs_access(fuse_req_t request, fuse_ino_t ino, int mask);
 static void sfs_forget_multi(fuse_req_t request,size_t count,struct fuse_forget_data *forgets);
+int generate_entry(uint64_t inode,struct fuse_entry_param *entry);
 int generate_and_reply_entry(fuse_req_t request,uint64_t inode);
+struct cached_directory;
+int cached_directory_add(struct cached_directory *directory_cache,uint64_t inode,uint32_t mode,const char *name);
+void cached_directory_free(struct cached_directory *directory_cache);
+void reply_cached_dirents(fuse_req_t request,size_t size,off_t offset,struct fuse_file_info *file_info,int plus);
 int referenced_inodes_bst_cmp(void *a,void *b);
 int increase_inode_ref_count(uint64_t inode, int count);
 int decrease_inode_ref_count(uint64_t inode, int count);
 void print_referenced_inode(void *);
 uint64_t generate_unique_runid();
 uint64_t inode_lookup_by_name(uint64_t parent,const char *name,sfs_inode_t *inode_return,uint64_t *inode_index_return);
-void scheduled_rmdir(void *data);
-void scheduled_unlink(void *data);
+uint64_t directory_search(uint64_t parent,const char *name,sfs_inode_t *inode_header_return,uint64_t *pointer_index_return);
+int pointer_index_of(uint64_t parent,uint64_t inode,uint64_t *pointer_index_return);
+int orphan_dirent(uint64_t parent,const char *name,uint64_t index,uint64_t inode);
+int orphan_inode(uint64_t inode);
+void reclaim_when_unreferenced(uint64_t inode);
+int is_ancestor(uint64_t ancestor,uint64_t inode);
+void scheduled_reclaim(void *data);
+void queue_reclaim(uint64_t inode);
+void *reclaim_thread(void *);
 void atexit_cleanup();
 void referenced_inode_call_destructor(void *date,void *user_data);
 void bitmask_to_string(uint64_t bitmask,size_t bit_count,char buffer[65]);
+int parse_mount_options(char *option_string);
+int parse_size(const char *string,unsigned int *size_return);
+void queue_inval_inode(uint64_t inode,off_t offset,off_t len);
+struct thread_buffers;
+struct thread_buffers *get_thread_buffers();
+void free_thread_buffers(void *data);
+void free_referenced_inode(void *data);
+void free_cached_directory_arrays(void *data,void *user_data);
+ssize_t map_file_to_bufvec(uint64_t inode,off_t offset,size_t size,struct fuse_bufvec **bufvec_return);
+char *bounce_extents(struct fuse_bufvec *extent_bufvec,size_t size,int writing);
+uint64_t *read_all_pointers(uint64_t inode,uint64_t pointer_count);
+void *invalidation_thread(void *);
+int is_stats_file(fuse_ino_t parent,const char *name);
+void stats_file_stat(struct stat *statbuf);
+void *stats_dump_thread(void *);
+void stats_file_open(fuse_req_t request,struct fuse_file_info *fi);
+char *format_stats(size_t *size_return);
 
 //====== prototypes for sfs_lowlevel_operations ======
 struct fuse_lowlevel_ops sfs_lowlevel_operations = {
+	.init = sfs_init,
 	.opendir = sfs_opendir,
 	.readdir = sfs_readdir,
+	.readdirplus = sfs_readdirplus,
 	.releasedir = sfs_releasedir,
 	.getattr = sfs_getattr,
 	.lookup = sfs_lookup,
@@ -66,19 +157,15 @@ struct fuse_lowlevel_ops sfs_lowlevel_operations = {
 	.mknod = sfs_mknod,
 	.setattr = sfs_setattr,
 	.unlink = sfs_unlink,
+	.rename = sfs_rename,
 	.open = sfs_open,
 	.release = sfs_release,
 	.read = sfs_read,
-	.write = sfs_write,
+	.write_buf = sfs_write_buf,
 	.access = sfs_access,
 };
 
 //====== types ======
-struct pointer_parent_inode_trio {
-	uint64_t pointer;
-	uint64_t parent;
-	uint64_t inode;
-};
 struct referenced_inode {
 	uint64_t inode;
 	int reference_count;
@@ -86,17 +173,64 @@ struct referenced_inode {
 	void (*destructor)(void *);
 };
 struct cached_dirent {
-	struct stat statbuf;
-	char name[SFS_MAX_FILENAME_SIZE];
+	uint64_t inode;
+	uint32_t mode;
+	uint32_t name_offset; //where the null terminated name starts in the name arena
 };
 struct cached_directory {
-	uint64_t inode;
+	uint64_t inode; //first so that it is the field overwritten while the struct sits freed in its slab
 	uint64_t dirent_count;
+	//the arrays are kept when the struct is freed back to its slab, so the next opendir can reuse them
+	uint64_t dirent_capacity;
 	struct cached_dirent *dirent_array;
+	//all the names packed back to back
+	char *name_arena;
+	size_t name_arena_used;
+	size_t name_arena_size;
 };
 struct open_file {
 	uint64_t inode;
 	int mode; //O_RDWR, O_WRONLY, O_WRONLY, O_APPEND
+	//only used by the stats file, the contents as they were when it was opened
+	char *snapshot;
+	size_t snapshot_size;
+};
+struct mount_options {
+	int kernel_cache; //let the kernel keep page and dentry caches, invalidating them when we change things
+	double attr_timeout;
+	double entry_timeout;
+	//capability negotiation in init
+	unsigned int max_write;
+	unsigned int max_readahead;
+	int async_read;
+	int writeback_cache;
+	int parallel_dirops;
+	int splice_read;
+	int splice_write;
+	int splice_move;
+	char *trace_path; //record every request to this file
+	int punch_holes; //give freed pages back to the host filesystem
+	int direct_io; //open the image with O_DIRECT
+	unsigned int reclaim_batch; //most pages the reclaim thread frees before letting requests back in
+	unsigned int dentry_cache_size; //names (found or not) remembered by the dentry cache
+};
+//scratch space each thread reuses for every request it handles
+struct thread_buffers {
+	struct slab_buffer readdir; //reply being packed by readdir
+	struct slab_buffer extent_bufvec; //struct fuse_bufvec describing where a file range lives in the image
+	struct slab_buffer extents; //struct sfs_extent array that is filled in by sfs_file_map
+	struct slab_buffer data; //file data passing through memory with o_direct
+	struct slab_buffer pointers; //every pointer of an inode, from read_all_pointers
+};
+struct pending_reclaim {
+	struct pending_reclaim *next;
+	uint64_t inode;
+};
+struct pending_invalidation {
+	struct pending_invalidation *next;
+	uint64_t inode;
+	off_t offset;
+	off_t len;
 };
 
 //====== globals ======
@@ -104,17 +238,73 @@ sfs_t *sfs_filesystem = NULL;
 BST *referenced_inodes;
 TABLE *cached_dirents;
 TABLE *open_file_table;
+//(parent, name) to inode, or to DCACHE_NEGATIVE for names that are known not to exist
+DCACHE *dentry_cache;
+struct fuse_session *session = NULL;
+//fixed size objects are recycled through these rather than malloc
+//(only ever touched from the fuse loop)
+SLAB *open_file_slab;
+SLAB *referenced_inode_slab;
+SLAB *cached_directory_slab;
+pthread_key_t thread_buffers_key;
+static _Thread_local struct thread_buffers *current_thread_buffers = NULL;
+struct mount_options mount_options = {
+	.kernel_cache = 0,
+	.attr_timeout = 1.0,
+	.entry_timeout = 1.0,
+	.max_write = 1024*1024,
+	.max_readahead = 1024*1024,
+	.async_read = 1,
+	.writeback_cache = 0,
+	.parallel_dirops = 1,
+	.splice_read = 0,
+	.splice_write = 0,
+	.splice_move = 0,
+	.trace_path = NULL,
+	.punch_holes = 0,
+	.direct_io = 0,
+	.reclaim_batch = 1024,
+	.dentry_cache_size = 16384,
+};
+//capabilities the kernel agreed to, filled in by init
+unsigned int granted_capabilities = 0;
+//invalidations must not be sent from inside the request that caused them (the kernel may be holding locks the notification needs)
+//so they are queued and sent from their own thread
+pthread_mutex_t invalidation_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t invalidation_cond = PTHREAD_COND_INITIALIZER;
+struct pending_invalidation *invalidation_queue_head = NULL;
+struct pending_invalidation *invalidation_queue_tail = NULL;
+int invalidation_thread_running = 0;
+//every request is recorded here when -o trace=FILE is given
+TRACE *request_trace = NULL;
+//SIGUSR1 is blocked everywhere and picked up by its own thread, which dumps the stats
+volatile int stats_dump_thread_running = 0;
+//held by every handler and by the reclaim thread while they use sfs_filesystem
+pthread_mutex_t filesystem_lock = PTHREAD_MUTEX_INITIALIZER;
+//unreferenced orphans waiting for their pages to be freed (protected by filesystem_lock)
+pthread_cond_t reclaim_cond = PTHREAD_COND_INITIALIZER;
+struct pending_reclaim *reclaim_queue_head = NULL;
+struct pending_reclaim *reclaim_queue_tail = NULL;
+int reclaim_thread_running = 0;
 
 int main(int argc, char **argv){
 	//====== register atexit functions ======
 	atexit(atexit_cleanup);
+	//====== block SIGUSR1 before any threads start so only the stats thread sees it ======
+	sigset_t stats_signal_set;
+	sigemptyset(&stats_signal_set);
+	sigaddset(&stats_signal_set,SIGUSR1);
+	pthread_sigmask(SIG_BLOCK,&stats_signal_set,NULL);
 	//====== initialise various variables ======
 	struct fuse_args f_args = FUSE_ARGS_INIT(1,argv);
-	struct fuse_session *session;
 	struct fuse_cmdline_opts options;
+	pthread_t invalidation_thread_id;
+	pthread_t stats_dump_thread_id;
 	static struct option long_options[] = {
 		{"fuse-args",	required_argument,	0,'f'},
-		{"help",	no_argument,		0,'h'}
+		{"options",	required_argument,	0,'o'},
+		{"help",	no_argument,		0,'h'},
+		{0,		0,			0,0}
 	};
 	//struct fuse_loop_config config;
 
@@ -123,18 +313,22 @@ int main(int argc, char **argv){
 	sfs_filesystem = &filesystem;
 
 	struct bst_user_functions bst_funcs = {
-		.free_data = free,
+		.free_data = free_referenced_inode,
 		.datacmp = referenced_inodes_bst_cmp,
 		.print_data = print_referenced_inode
 	};
 	referenced_inodes = bst_new(&bst_funcs);
 	cached_dirents = table_new(MAX_OPEN_DIRS);
 	open_file_table = table_new(MAX_OPEN_FILES);
+	open_file_slab = slab_new(sizeof(struct open_file),sizeof(uint64_t),256);
+	referenced_inode_slab = slab_new(sizeof(struct referenced_inode),sizeof(uint64_t),256);
+	cached_directory_slab = slab_new(sizeof(struct cached_directory),sizeof(uint64_t),64);
+	pthread_key_create(&thread_buffers_key,free_thread_buffers);
 	
 	//====== process our custom arguments first ======
 	for (;;){
 		int option_index = 0;
-		int result = getopt_long(argc,argv,"hf:",long_options,&option_index);
+		int result = getopt_long(argc,argv,"hf:o:",long_options,&option_index);
 		if (result == -1) break; //end of option arguments
 		switch(result){
 			case 'f':
@@ -146,6 +340,13 @@ int main(int argc, char **argv){
 				fuse_opt_add_arg(&f_args,full_arg);
 				free(full_arg);
 				break;
+			case 'o':
+				//====== our own mount options ======
+				if (parse_mount_options(optarg) != 0){
+					show_usage(argv[0]);
+					return 1;
+				}
+				break;
 			case 'h':
 				//help
 				show_usage(argv[0]);
@@ -161,13 +362,43 @@ int main(int argc, char **argv){
 	}
 	char *filesystem_path = argv[optind];
 	char *mountpoint = argv[optind+1];
+	dentry_cache = dcache_new(mount_options.dentry_cache_size);
+	if (dentry_cache == NULL){
+		fprintf(stderr,"Could not create the dentry cache: %s\n",strerror(errno));
+		return 1;
+	}
 
 	//====== open the filesystem ======
-	int result = sfs_open_fs(sfs_filesystem,filesystem_path,0);
+	int open_flags = 0;
+	if (mount_options.punch_holes) open_flags |= SFS_FUNC_FLAG_PUNCH_HOLES;
+	if (mount_options.direct_io) open_flags |= SFS_FUNC_FLAG_DIRECT_IO;
+	int result = sfs_open_fs(sfs_filesystem,filesystem_path,open_flags);
 	if (result < 0){
 		fprintf(stderr,"Could not open filesystem.\n");
 		return 1;
 	}
+	//====== finish off anything unlinked before the last unmount or crash ======
+	//nothing can reference the orphans yet, so they all go straight to the reclaim thread
+	uint64_t orphan_count = 0;
+	for (uint64_t orphan = sfs_filesystem->orphan_list_head; orphan != 0 && orphan_count <= sfs_filesystem->page_count; orphan_count++){
+		sfs_inode_t orphan_header;
+		if (sfs_read_inode_header(sfs_filesystem,orphan,&orphan_header) != 0){
+			fprintf(stderr,"Could not read orphaned inode %lu: %s\n",orphan,strerror(errno));
+			break;
+		}
+		queue_reclaim(orphan);
+		orphan = orphan_header.parent_inode_pointer;
+	}
+	if (orphan_count > 0) LOG_INFO("reclaiming %lu orphaned inodes",orphan_count);
+
+	//====== start recording requests ======
+	if (mount_options.trace_path != NULL){
+		request_trace = trace_create(mount_options.trace_path);
+		if (request_trace == NULL){
+			fprintf(stderr,"Could not create trace %s: %s\n",mount_options.trace_path,strerror(errno));
+			return 1;
+		}
+	}
 
 	//====== parse arguments ======
 	if (fuse_parse_cmdline(&f_args,&options) != 0) return 1;
@@ -200,6 +431,33 @@ int main(int argc, char **argv){
 		fuse_opt_free_args(&f_args);
 		return -1;
 	}
+	//====== from here on messages are written by a background thread ======
+	if (log_start(stderr) != 0){
+		fprintf(stderr,"Could not start logging thread, logging synchronously\n");
+	}
+	//====== start sending cache invalidations ======
+	if (mount_options.kernel_cache){
+		invalidation_thread_running = 1;
+		if (pthread_create(&invalidation_thread_id,NULL,invalidation_thread,NULL) != 0){
+			LOG_ERROR("pthread_create: could not start the invalidation thread");
+			invalidation_thread_running = 0;
+		}
+	}
+
+	//====== free the pages of deleted files in the background ======
+	reclaim_thread_running = 1;
+	pthread_t reclaim_thread_id;
+	if (pthread_create(&reclaim_thread_id,NULL,reclaim_thread,NULL) != 0){
+		LOG_ERROR("pthread_create: could not start the reclaim thread, deleted files will be reclaimed on the next mount");
+		reclaim_thread_running = 0;
+	}
+
+	//====== dump stats on SIGUSR1 ======
+	stats_dump_thread_running = 1;
+	if (pthread_create(&stats_dump_thread_id,NULL,stats_dump_thread,NULL) != 0){
+		LOG_ERROR("pthread_create: could not start the stats thread");
+		stats_dump_thread_running = 0;
+	}
 
 	//fuse_daemonize(options.foreground);
 	//single threaded (lets keep it simple)
@@ -220,27 +478,75 @@ int main(int argc, char **argv){
 
 	//=========================================
 
-	printf("====== unmounting filesystem ======\n");
+	LOG_INFO("====== unmounting filesystem ======");
 	//====== cleanup ======
-	printf("closing down fuse\n");
+	LOG_INFO("closing down fuse");
+	if (invalidation_thread_running){
+		pthread_mutex_lock(&invalidation_lock);
+		invalidation_thread_running = 0;
+		pthread_cond_signal(&invalidation_cond);
+		pthread_mutex_unlock(&invalidation_lock);
+		pthread_join(invalidation_thread_id,NULL);
+	}
+	if (reclaim_thread_running){
+		//whatever it has not got to stays on the orphan list for the next mount
+		pthread_mutex_lock(&filesystem_lock);
+		reclaim_thread_running = 0;
+		pthread_cond_signal(&reclaim_cond);
+		pthread_mutex_unlock(&filesystem_lock);
+		pthread_join(reclaim_thread_id,NULL);
+	}
+	if (stats_dump_thread_running){
+		stats_dump_thread_running = 0;
+		pthread_kill(stats_dump_thread_id,SIGUSR1);
+		pthread_join(stats_dump_thread_id,NULL);
+	}
 	fuse_session_unmount(session);
 	fuse_remove_signal_handlers(session);
 	fuse_session_destroy(session);
 	fuse_opt_free_args(&f_args);
+	//no more requests can arrive
+	if (request_trace != NULL){
+		if (trace_close(request_trace) != 0) LOG_ERROR("trace_close: %s",strerror(errno));
+		request_trace = NULL;
+	}
 
-	//actual filesystem closed during atexit() function
+	//the filesystem is closed at the end, after the last of the stats (atexit() closes it on the way out of an early exit)
 
-	printf("====== cleaning up data structures ======\n");
+	LOG_INFO("====== cleaning up data structures ======");
 	bst_foreach(referenced_inodes,referenced_inode_call_destructor,NULL);//no user data needs to be passed so have it as NULL
 	bst_delete(referenced_inodes);
+	for (;reclaim_queue_head != NULL;){
+		struct pending_reclaim *reclaim = reclaim_queue_head;
+		reclaim_queue_head = reclaim->next;
+		free(reclaim);
+	}
+	reclaim_queue_tail = NULL;
 	table_delete(cached_dirents);
 	table_delete(open_file_table);
+	dcache_delete(dentry_cache);
+	slab_foreach_free(cached_directory_slab,free_cached_directory_arrays,NULL);
+	slab_delete(cached_directory_slab);
+	slab_delete(open_file_slab);
+	slab_delete(referenced_inode_slab);
+	//thread specific destructors dont run for the main thread
+	free_thread_buffers(get_thread_buffers());
+	pthread_setspecific(thread_buffers_key,NULL);
+	//====== how much I/O each operation really cost ======
+	fprintf(stderr,"====== libsfs I/O ======\n");
+	sfs_print_io_report(sfs_filesystem,stderr);
+	//libsfs times its operations into the stats, so it has to be closed before they are freed
+	LOG_INFO("closing underlying filesystem");
+	sfs_close_fs(sfs_filesystem,0);
+	sfs_filesystem = NULL;
+	log_stop();
+	stats_cleanup();
 
 	return return_val;
 }
 void atexit_cleanup(){
 	if (sfs_filesystem != NULL){
-		printf("closing underlying filesystem\n");
+		LOG_INFO("closing underlying filesystem");
 		sfs_close_fs(sfs_filesystem,0);
 	}
 }
@@ -298,154 +604,244 @@ int _access(uint64_t inode,int access_modes){
 	return ((access_modes & permitions) == access_modes);
 }
 static void sfs_opendir(fuse_req_t request,fuse_ino_t ino,struct fuse_file_info *file_info){
-	printf("opendir requested on inode %lu\n",ino);
-	printf("====== inode %lu contains ======\n",ino);
+	HANDLER_SCOPE(TRACE_OP_OPENDIR,ino);
+	LOG_DEBUG("opendir requested on inode %lu",ino);
+	if (ino == STATS_INODE){
+		fuse_reply_err(request,ENOTDIR);
+		return;
+	}
 	//====== setup cache ======
 	int cache_index = table_allocate_index(cached_dirents);
 	if (cache_index == -1){
 		assert(fuse_reply_err(request,EMFILE) == 0);
 		return;
 	}
-	struct cached_directory *directory_cache = malloc(sizeof(struct cached_directory));
-	table_set_data(cached_dirents,cache_index,directory_cache);
 	//read the parent inode headers
 	sfs_inode_t inode;
-	assert(sfs_read_inode_header(sfs_filesystem,ino,&inode) == 0);
+	if (sfs_read_inode_header(sfs_filesystem,ino,&inode) != 0){
+		table_free_index(cached_dirents,cache_index);
+		fuse_reply_err(request,EIO);
+		return;
+	}
+	struct cached_directory *directory_cache = slab_alloc(cached_directory_slab);
+	if (directory_cache == NULL){
+		table_free_index(cached_dirents,cache_index);
+		fuse_reply_err(request,ENOMEM);
+		return;
+	}
 	directory_cache->inode = ino;
-	directory_cache->dirent_count = inode.pointer_count;
-	directory_cache->dirent_array = malloc(sizeof(struct cached_dirent)*inode.pointer_count);
+	directory_cache->dirent_count = 0;
+	directory_cache->name_arena_used = 0;
+	//only allocate if the recycled array is too small
+	if (inode.pointer_count > directory_cache->dirent_capacity){
+		struct cached_dirent *new_array = realloc(directory_cache->dirent_array,sizeof(struct cached_dirent)*inode.pointer_count);
+		if (new_array == NULL){
+			cached_directory_free(directory_cache);
+			table_free_index(cached_dirents,cache_index);
+			fuse_reply_err(request,ENOMEM);
+			return;
+		}
+		directory_cache->dirent_array = new_array;
+		directory_cache->dirent_capacity = inode.pointer_count;
+	}
 	//====== cache all the dirents ======
-	uint64_t dirent_index = 0; //may differ from pointer_index as it takes into account invisible inodes that have a referenced destructor but havent been deleted yet
+	uint64_t *dirents = read_all_pointers(ino,inode.pointer_count);
+	if (dirents == NULL){
+		int error = errno;
+		LOG_ERROR("sfs_inode_get_pointers: %s",strerror(error));
+		cached_directory_free(directory_cache);
+		table_free_index(cached_dirents,cache_index);
+		fuse_reply_err(request,error);
+		return;
+	}
 	for (uint64_t pointer_index = 0; pointer_index < inode.pointer_count; pointer_index++){
-		uint64_t dirent = sfs_inode_get_pointer(sfs_filesystem,ino,pointer_index);
-		if (dirent == (uint64_t)-1){
-			perror("sfs_inode_get_pointer");
-			fuse_reply_err(request,errno);
-		}
-		//------ dont add the inode if it has a destructor queued ------
-		struct referenced_inode referenced_inode_to_match;
-		memset(&referenced_inode_to_match,0,sizeof(struct referenced_inode));
-		referenced_inode_to_match.inode = dirent;
-		struct bst_node *bst_node = bst_find_node(referenced_inodes,&referenced_inode_to_match);
-		if (bst_node != NULL){
-			//dont add it if it has a scheduled destructor
-			struct referenced_inode *node = bst_node->data;
-			if (node->destructor != NULL){
-				directory_cache->dirent_count--;
-				continue;
-			}
-		}
-		//read the name
-		if (sfs_stat(dirent,&directory_cache->dirent_array[dirent_index].statbuf) != 0){
-			fuse_reply_err(request,2); //no such file or directory
+		uint64_t dirent = dirents[pointer_index];
+		//read the name and type (the rest of the stat is only fetched when it is sent)
+		sfs_inode_t child_inode;
+		if (sfs_read_inode_header(sfs_filesystem,dirent,&child_inode) != 0 || cached_directory_add(directory_cache,dirent,child_inode.mode,child_inode.name) != 0){
+			cached_directory_free(directory_cache);
+			table_free_index(cached_dirents,cache_index);
+			fuse_reply_err(request,ENOENT); //no such file or directory
 			return;
 		}
-		sfs_inode_t inode;
-		assert(sfs_read_inode_header(sfs_filesystem,dirent,&inode) == 0);
-		memcpy(directory_cache->dirent_array[dirent_index].name,inode.name,SFS_MAX_FILENAME_SIZE);
-		dirent_index++;
-		printf("%lu [%s]\n",dirent,inode.name);
 	}
-
-	printf("====== end of inode ======\n");
+	LOG_DEBUG("opendir on inode %lu cached %lu entries",ino,directory_cache->dirent_count);
 	//====== send it off ======
+	table_set_data(cached_dirents,cache_index,directory_cache);
 	file_info->fh = cache_index;
 	assert(fuse_reply_open(request,file_info) == 0);
 }
+//appends a dirent to the snapshot, copying its name into the name arena
+int cached_directory_add(struct cached_directory *directory_cache,uint64_t inode,uint32_t mode,const char *name){
+	size_t name_length = strnlen(name,SFS_MAX_FILENAME_SIZE-1)+1;
+	if (directory_cache->name_arena_used+name_length > UINT32_MAX){
+		errno = EOVERFLOW;
+		return -1;
+	}
+	//====== grow the arena by doubling if needed ======
+	if (directory_cache->name_arena_used+name_length > directory_cache->name_arena_size){
+		size_t new_size = (directory_cache->name_arena_size == 0) ? 4096 : directory_cache->name_arena_size*2;
+		for (;new_size < directory_cache->name_arena_used+name_length;) new_size *= 2;
+		char *new_arena = realloc(directory_cache->name_arena,new_size);
+		if (new_arena == NULL){
+			return -1;
+		}
+		directory_cache->name_arena = new_arena;
+		directory_cache->name_arena_size = new_size;
+	}
+	//====== add the record ======
+	struct cached_dirent *dirent = &directory_cache->dirent_array[directory_cache->dirent_count];
+	dirent->inode = inode;
+	dirent->mode = mode;
+	dirent->name_offset = directory_cache->name_arena_used;
+	memcpy(directory_cache->name_arena+directory_cache->name_arena_used,name,name_length-1);
+	directory_cache->name_arena[directory_cache->name_arena_used+name_length-1] = '\0';
+	directory_cache->name_arena_used += name_length;
+	directory_cache->dirent_count++;
+	return 0;
+}
+//the arrays stay with the struct for the next opendir to reuse
+void cached_directory_free(struct cached_directory *directory_cache){
+	slab_free(cached_directory_slab,directory_cache);
+}
+void free_cached_directory_arrays(void *data,void *user_data){
+	struct cached_directory *directory_cache = data;
+	free(directory_cache->dirent_array);
+	free(directory_cache->name_arena);
+}
 static void sfs_readdir(fuse_req_t request,fuse_ino_t ino,size_t size,off_t offset,struct fuse_file_info *file_info){
+	HANDLER_SCOPE(TRACE_OP_READDIR,ino);
+	HANDLER_TRACE(offset,offset);
+	HANDLER_TRACE(size,size);
+	reply_cached_dirents(request,size,offset,file_info,0);
+}
+static void sfs_readdirplus(fuse_req_t request,fuse_ino_t ino,size_t size,off_t offset,struct fuse_file_info *file_info){
+	HANDLER_SCOPE(TRACE_OP_READDIRPLUS,ino);
+	HANDLER_TRACE(offset,offset);
+	HANDLER_TRACE(size,size);
+	reply_cached_dirents(request,size,offset,file_info,1);
+}
+//shared by readdir and readdirplus, plus = 1 sends full entries (and takes a lookup reference on each one sent)
+void reply_cached_dirents(fuse_req_t request,size_t size,off_t offset,struct fuse_file_info *file_info,int plus){
 	//====== read the cache ======
 	struct cached_directory *directory_cache = table_get_data(cached_dirents,file_info->fh);
-	if (offset >= directory_cache->dirent_count){
-		//====== no more dirents ======
-		assert(fuse_reply_buf(request,NULL,0) == 0);
-	}else{
-		//====== send the next dirent ======
-		//get required buffer size
-		size_t bufsize = fuse_add_direntry(request,NULL,0,directory_cache->dirent_array[offset].name,&directory_cache->dirent_array[offset].statbuf,offset+1);
-		assert(bufsize <= size);
-		char *buf = malloc(bufsize);
-		//pack the buffer
-		assert(fuse_add_direntry(request,buf,bufsize,directory_cache->dirent_array[offset].name,&directory_cache->dirent_array[offset].statbuf,offset+1) <= bufsize);
-		//send the buffer
-		assert(fuse_reply_buf(request,buf,bufsize) == 0);
-		//free the buffer
-		free(buf);
+	//====== make sure the reply buffer can hold as much as the kernel offered ======
+	//the buffer is reused between calls so listing a directory does not allocate per request
+	struct thread_buffers *buffers = get_thread_buffers();
+	if (slab_buffer_reserve(&buffers->readdir,size) != 0){
+		fuse_reply_err(request,ENOMEM);
+		return;
+	}
+	char *readdir_buffer = buffers->readdir.data;
+	//====== pack as many dirents as will fit ======
+	size_t bytes_used = 0;
+	for (uint64_t dirent_index = offset; dirent_index < directory_cache->dirent_count; dirent_index++){
+		struct cached_dirent *dirent = &directory_cache->dirent_array[dirent_index];
+		const char *name = directory_cache->name_arena+dirent->name_offset;
+		size_t entry_size;
+		if (plus){
+			//full attributes are read now rather than being held in the snapshot
+			struct fuse_entry_param entry;
+			if (generate_entry(dirent->inode,&entry) != 0){
+				//stop here and send what we have, the next call will retry this entry
+				if (bytes_used > 0) break;
+				fuse_reply_err(request,EIO);
+				return;
+			}
+			entry_size = fuse_add_direntry_plus(request,readdir_buffer+bytes_used,size-bytes_used,name,&entry,dirent_index+1);
+			if (entry_size > size-bytes_used) break;
+			//the kernel treats every entry it is sent as a lookup, so it will forget it later
+			increase_inode_ref_count(entry.ino,1);
+		}else{
+			//only the inode and file type are used for plain dirents
+			struct stat statbuf = {
+				.st_ino = dirent->inode,
+				.st_mode = dirent->mode,
+			};
+			entry_size = fuse_add_direntry(request,readdir_buffer+bytes_used,size-bytes_used,name,&statbuf,dirent_index+1);
+		}
+		//if it didnt fit, it is left for the next readdir call (which starts at this offset)
+		if (entry_size > size-bytes_used) break;
+		bytes_used += entry_size;
 	}
+	//====== send the buffer (an empty buffer signals no more dirents) ======
+	assert(fuse_reply_buf(request,readdir_buffer,bytes_used) == 0);
 }
 static void sfs_releasedir(fuse_req_t request,fuse_ino_t ino,struct fuse_file_info *file_info){
+	HANDLER_SCOPE(TRACE_OP_RELEASEDIR,ino);
 	//free all the cached data
 	struct cached_directory *directory_cache = table_get_data(cached_dirents,file_info->fh);
-	free(directory_cache->dirent_array);
-	free(directory_cache);
+	cached_directory_free(directory_cache);
 	table_free_index(cached_dirents,file_info->fh);
 	//send success
 	assert(fuse_reply_err(request,0) == 0);
 }
 static void sfs_getattr(fuse_req_t request,fuse_ino_t ino,struct fuse_file_info *file_info){
-	printf("getattr requested on inode %lu\n",ino);
+	HANDLER_SCOPE(TRACE_OP_GETATTR,ino);
+	LOG_DEBUG("getattr requested on inode %lu",ino);
 	//send the gathered attribute back to the kernel
 	struct stat attr;
+	if (ino == STATS_INODE){
+		stats_file_stat(&attr);
+		assert(fuse_reply_attr(request,&attr,0) == 0);
+		return;
+	}
 	assert(sfs_stat(ino,&attr) == 0);
-	assert(fuse_reply_attr(request,&attr,1.0) == 0);
+	assert(fuse_reply_attr(request,&attr,mount_options.attr_timeout) == 0);
 }
 static void show_usage(char *name){
 	printf("usage: %s [options] <filesystem image> <mountpoint>\n",name);
 }
 static void sfs_lookup(fuse_req_t request,fuse_ino_t parent,const char *name){
-	printf("lookup requested on parent %lu for %s\n",parent,name);
-	//====== check parent is a directory ======
-	sfs_inode_t inode;
-	assert(sfs_read_inode_header(sfs_filesystem,parent,&inode) == 0);
-	if (!S_ISDIR(inode.mode)){
-		fuse_reply_err(request,ENOTDIR);
+	HANDLER_SCOPE(TRACE_OP_LOOKUP,parent);
+	HANDLER_TRACE_NAME(name);
+	LOG_DEBUG("lookup requested on parent %lu for %s",parent,name);
+	if (is_stats_file(parent,name)){
+		//not reference counted, it can never be deleted
+		struct fuse_entry_param entry;
+		memset(&entry,0,sizeof(struct fuse_entry_param));
+		entry.ino = STATS_INODE;
+		stats_file_stat(&entry.attr);
+		fuse_reply_entry(request,&entry);
 		return;
 	}
-	//====== itterate through all the entries in a directory ======
-	for (uint64_t i = 0; i < inode.pointer_count;i++){
-		uint64_t sub_inode_pointer = sfs_inode_get_pointer(sfs_filesystem,parent,i);
-		assert(sub_inode_pointer != (uint64_t)-1);
-		sfs_inode_t sub_inode;
-		assert(sfs_read_inode_header(sfs_filesystem,sub_inode_pointer,&sub_inode) == 0);
-		if (strcmp(sub_inode.name,name) == 0){
-			//====== directory found ======
-			//check if destructor is queued
-			struct referenced_inode referenced_inode_to_match;
-			memset(&referenced_inode_to_match,0,sizeof(struct referenced_inode));
-			referenced_inode_to_match.inode = sub_inode_pointer;
-			struct bst_node *bst_node = bst_find_node(referenced_inodes,&referenced_inode_to_match);
-			if (bst_node != NULL){
-				//if it is, act like it doesnt exist
-				struct referenced_inode *node = bst_node->data;
-				if (node->destructor != NULL){
-					continue;
-				}
-			}
-			//generate the dir entry
-			int result = generate_and_reply_entry(request,sub_inode_pointer);
-			if (result != 0){
-				fuse_reply_err(request,result);
-			}
-			return;
-		}
+	//====== find it (misses are cached too, so probing for files that are not there stays cheap) ======
+	uint64_t inode = inode_lookup_by_name(parent,name,NULL,NULL);
+	if (inode == (uint64_t)-1){
+		fuse_reply_err(request,errno);
+		return;
+	}
+	//generate the dir entry
+	HANDLER_TRACE(result,inode);
+	int result = generate_and_reply_entry(request,inode);
+	if (result != 0){
+		fuse_reply_err(request,result);
 	}
-	//====== if it does not exist ======
-	fuse_reply_err(request,ENOENT);
 }
 static void sfs_mkdir(fuse_req_t request,fuse_ino_t parent,const char *name,mode_t mode){
-	printf("mkdir requested for [%s] with parent %lu\n",name,parent);
+	HANDLER_SCOPE(TRACE_OP_MKDIR,parent);
+	HANDLER_TRACE_NAME(name);
+	HANDLER_TRACE(mode,mode);
+	LOG_DEBUG("mkdir requested for [%s] with parent %lu",name,parent);
 	//====== verify it doesnt already exist ======
-	if (inode_lookup_by_name(parent,name,NULL,NULL) != (uint64_t)-1){
+	if (is_stats_file(parent,name) || inode_lookup_by_name(parent,name,NULL,NULL) != (uint64_t)-1){
 		//file / folder exists already
 		fuse_reply_err(request,EEXIST);
 		return;
 	}
+	if (errno != ENOENT){
+		fuse_reply_err(request,errno);
+		return;
+	}
 	//====== create the new inode ======
 	uint64_t new_inode = sfs_inode_create(sfs_filesystem,name,mode | S_IFDIR,getuid(),getgid(),parent);
 	if (new_inode == (uint64_t)-1){
 		fuse_reply_err(request,errno);
 		return;
 	}
-	printf("mkdir created new inode %lu\n",new_inode);
+	dcache_insert(dentry_cache,parent,name,new_inode);
+	LOG_DEBUG("mkdir created new inode %lu",new_inode);
+	HANDLER_TRACE(result,new_inode);
 	
 	//update superblock
 	sfs_update_superblock(sfs_filesystem);
@@ -466,29 +862,25 @@ int referenced_inodes_bst_cmp(void *a,void *b){
 }
 int increase_inode_ref_count(uint64_t inode, int count){
 	//====== create node to hold ref count if needed ======
-	struct referenced_inode *referenced_inode_to_match = malloc(sizeof(struct referenced_inode));
-	memset(referenced_inode_to_match,0,sizeof(struct referenced_inode));
-	referenced_inode_to_match->inode = inode;
-	struct bst_node *ref_node = bst_find_node(referenced_inodes,referenced_inode_to_match);
+	struct referenced_inode referenced_inode_to_match;
+	memset(&referenced_inode_to_match,0,sizeof(struct referenced_inode));
+	referenced_inode_to_match.inode = inode;
+	struct bst_node *ref_node = bst_find_node(referenced_inodes,&referenced_inode_to_match);
 	if (ref_node == NULL){
 		//create a new node
-		ref_node = bst_new_node(referenced_inodes,referenced_inode_to_match);
-	}else{
-		free(referenced_inode_to_match);
+		struct referenced_inode *new_referenced_inode = slab_alloc(referenced_inode_slab);
+		if (new_referenced_inode == NULL) return -1;
+		memcpy(new_referenced_inode,&referenced_inode_to_match,sizeof(struct referenced_inode));
+		ref_node = bst_new_node(referenced_inodes,new_referenced_inode);
 	}
 	//====== increment ref count ======
 	struct referenced_inode *ref_count_node = ref_node->data;
 	ref_count_node->reference_count += count;
 
-	printf("====== reference counts ======\n");
-	bst_print_nodes_inorder(referenced_inodes);
-	printf("====== end reference counts ======\n");
+	LOG_DEBUG("inode %lu reference count now %d",inode,ref_count_node->reference_count);
 	return 0;
 }
 int decrease_inode_ref_count(uint64_t inode, int count){
-	printf("====== reference counts ======\n");
-	bst_print_nodes_inorder(referenced_inodes);
-	printf("====== end reference counts ======\n");
 	//====== locate the inode in the bst ======
 	struct referenced_inode referenced_inode_to_match;
 	memset(&referenced_inode_to_match,0,sizeof(struct referenced_inode));
@@ -502,11 +894,12 @@ int decrease_inode_ref_count(uint64_t inode, int count){
 	if (ref_node == NULL) return -1; //inode does not have a reference count entry
 	//decrease the reference count
 	ref_node->reference_count -= count;
+	LOG_DEBUG("inode %lu reference count now %d",inode,ref_node->reference_count);
 	if (ref_node->reference_count < 1){
 		//====== inode reference count reached zero ======
 		//call the destructor if there is one
 		if (ref_node->destructor != NULL){
-			printf("calling inode %lu's destructor\n",inode);
+			LOG_DEBUG("calling inode %lu's destructor",inode);
 			ref_node->destructor(ref_node->data);
 			ref_node->destructor = NULL;
 			ref_node->data = NULL;
@@ -516,6 +909,9 @@ int decrease_inode_ref_count(uint64_t inode, int count){
 	}
 	return 0;
 }
+void free_referenced_inode(void *data){
+	slab_free(referenced_inode_slab,data);
+}
 void print_referenced_inode(void *data){
 	struct referenced_inode *inode_reference = data;
 	sfs_inode_t header;
@@ -532,23 +928,55 @@ uint64_t generate_unique_runid(){
 }
 
 static void sfs_forget(fuse_req_t request,fuse_ino_t ino, uint64_t lookup){
-	printf("inode %lu forgotten\n",ino);
-	decrease_inode_ref_count(ino,lookup);
+	HANDLER_SCOPE(TRACE_OP_FORGET,ino);
+	HANDLER_TRACE(size,lookup);
+	LOG_DEBUG("inode %lu forgotten",ino);
+	if (ino != STATS_INODE) decrease_inode_ref_count(ino,lookup);
 	//no reply required
 	fuse_reply_none(request);
 }
+//finds name in parent, from the dentry cache if it is there and by reading the directory if not
+//returns (uint64_t)-1 with errno set to ENOENT when it does not exist, or to anything else if the directory could not be read
 uint64_t inode_lookup_by_name(uint64_t parent,const char *name,sfs_inode_t *inode_header_return,uint64_t *pointer_index_return){
+	//====== answered from memory ======
+	uint64_t inode;
+	if (dcache_lookup(dentry_cache,parent,name,&inode)){
+		if (inode == DCACHE_NEGATIVE){
+			errno = ENOENT;
+			return (uint64_t)-1;
+		}
+		if (inode_header_return != NULL && sfs_read_inode_header(sfs_filesystem,inode,inode_header_return) != 0) return (uint64_t)-1;
+		//only the pointers have to be read to find the index, not every inode they point at
+		if (pointer_index_return != NULL && pointer_index_of(parent,inode,pointer_index_return) != 0) return (uint64_t)-1;
+		return inode;
+	}
+	//====== read the directory ======
+	inode = directory_search(parent,name,inode_header_return,pointer_index_return);
+	//a failed read says nothing about whether it exists
+	if (inode != (uint64_t)-1 || errno == ENOENT){
+		dcache_insert(dentry_cache,parent,name,(inode == (uint64_t)-1) ? DCACHE_NEGATIVE : inode);
+		if (inode == (uint64_t)-1) errno = ENOENT;
+	}
+	return inode;
+}
+uint64_t directory_search(uint64_t parent,const char *name,sfs_inode_t *inode_header_return,uint64_t *pointer_index_return){
 	//====== get pointer count ======
 	sfs_inode_t parent_header;
-	sfs_read_inode_header(sfs_filesystem,parent,&parent_header);
+	if (sfs_read_inode_header(sfs_filesystem,parent,&parent_header) != 0) return (uint64_t)-1;
+	if (!S_ISDIR(parent_header.mode)){
+		errno = ENOTDIR;
+		return (uint64_t)-1;
+	}
 	uint64_t pointer_count = parent_header.pointer_count;
+	uint64_t *inodes = read_all_pointers(parent,pointer_count);
+	if (inodes == NULL) return (uint64_t)-1;
 	//====== linear search for matching name ======
 	for (uint64_t i = 0; i < pointer_count; i++){
 		//get the inode
-		uint64_t inode = sfs_inode_get_pointer(sfs_filesystem,parent,i);
+		uint64_t inode = inodes[i];
 		//read the inode header
 		sfs_inode_t child_inode_header;
-		sfs_read_inode_header(sfs_filesystem,inode,&child_inode_header);
+		if (sfs_read_inode_header(sfs_filesystem,inode,&child_inode_header) != 0) return (uint64_t)-1;
 		//compare the name to the name we were given
 		if (strcmp(child_inode_header.name,name) == 0){
 			//copy the header info if requested
@@ -560,70 +988,78 @@ uint64_t inode_lookup_by_name(uint64_t parent,const char *name,sfs_inode_t *inod
 		}
 	}
 	//failure to find
+	errno = ENOENT;
 	return (uint64_t)-1;
 }
+//where inode is in parent's pointers
+int pointer_index_of(uint64_t parent,uint64_t inode,uint64_t *pointer_index_return){
+	sfs_inode_t parent_header;
+	if (sfs_read_inode_header(sfs_filesystem,parent,&parent_header) != 0) return -1;
+	uint64_t *inodes = read_all_pointers(parent,parent_header.pointer_count);
+	if (inodes == NULL) return -1;
+	for (uint64_t i = 0; i < parent_header.pointer_count; i++){
+		if (inodes[i] == inode){
+			*pointer_index_return = i;
+			return 0;
+		}
+	}
+	errno = ENOENT;
+	return -1;
+}
 static void sfs_rmdir(fuse_req_t request, fuse_ino_t parent, const char *name){
+	HANDLER_SCOPE(TRACE_OP_RMDIR,parent);
+	HANDLER_TRACE_NAME(name);
+	if (is_stats_file(parent,name)){
+		fuse_reply_err(request,ENOTDIR);
+		return;
+	}
 	//====== find the inode ======
+	sfs_inode_t headers;
 	uint64_t index;
-	uint64_t inode = inode_lookup_by_name(parent,name,NULL,&index);
+	uint64_t inode = inode_lookup_by_name(parent,name,&headers,&index);
 	if (inode == (uint64_t)-1){
-		fuse_reply_err(request,ENOENT);
+		fuse_reply_err(request,errno);
 		return;
 	}
-	//====== schedule removal ======
-	//prepare data
-	struct pointer_parent_inode_trio *data = malloc(sizeof(struct pointer_parent_inode_trio));
-	data->pointer = index;
-	data->parent = parent;
-	data->inode = inode;
-	//find entry
-	struct referenced_inode match = {
-		.inode = inode
-	};
-	struct bst_node *node = bst_find_node(referenced_inodes,&match);
-	if (node == NULL){
-		//if unreferenced delete now
-		scheduled_rmdir(data);
-		goto success;
+	if (!S_ISDIR(headers.mode)){
+		fuse_reply_err(request,ENOTDIR);
+		return;
 	}
-	//schedule deletion
-	((struct referenced_inode *)(node->data))->destructor = scheduled_rmdir;
-	((struct referenced_inode *)(node->data))->data = data;
-	
-	//signal success
-	success:
-	fuse_reply_err(request,0);
-}
-void scheduled_rmdir(void *data){
-	//====== unpack data ======
-	struct pointer_parent_inode_trio *typed_data = data;
-	uint64_t pointer = typed_data->pointer;
-	uint64_t parent = typed_data->parent;
-	uint64_t inode = typed_data->inode;
-	printf("deleting inode %lu (directory)\n",inode);
-
-	//====== delete the reference in the parent ======
-	assert(sfs_inode_remove_pointer(sfs_filesystem,parent,pointer) == 0);
-	//====== free the page ======
-	assert(sfs_free_page(sfs_filesystem,inode) == 0);
-
-	//update superblock
-	sfs_update_superblock(sfs_filesystem);
-
-	free(data);
+	//its entries would be lost along with it
+	if (headers.pointer_count > 0){
+		fuse_reply_err(request,ENOTEMPTY);
+		return;
+	}
+	int result = orphan_dirent(parent,name,index,inode);
+	//nothing can be looked up under it any more, and its inode number will be reused
+	if (result == 0) dcache_remove_parent(dentry_cache,inode);
+	fuse_reply_err(request,result);
 }
 static void sfs_mknod(fuse_req_t request, fuse_ino_t parent, const char *name, mode_t mode, dev_t rdev){
-	printf("mknod requested for [%s] under parent %lu\n",name,parent);
+	HANDLER_SCOPE(TRACE_OP_MKNOD,parent);
+	HANDLER_TRACE_NAME(name);
+	HANDLER_TRACE(mode,mode);
+	LOG_DEBUG("mknod requested for [%s] under parent %lu",name,parent);
 	//====== assert we only support regular files ======
 	if (!S_ISREG(mode)){
 		fuse_reply_err(request,ENOTSUP);
 		return;
 	}
+	if (is_stats_file(parent,name) || inode_lookup_by_name(parent,name,NULL,NULL) != (uint64_t)-1){
+		fuse_reply_err(request,EEXIST);
+		return;
+	}
+	if (errno != ENOENT){
+		fuse_reply_err(request,errno);
+		return;
+	}
 	uint64_t new_inode = sfs_inode_create(sfs_filesystem,name,mode,getuid(),getgid(),parent);
 	if (new_inode == (uint64_t)-1){
 		fuse_reply_err(request,errno);
 		return;
 	}
+	dcache_insert(dentry_cache,parent,name,new_inode);
+	HANDLER_TRACE(result,new_inode);
 
 	//update superblock
 	sfs_update_superblock(sfs_filesystem);
@@ -634,19 +1070,22 @@ static void sfs_mknod(fuse_req_t request, fuse_ino_t parent, const char *name, m
 		fuse_reply_err(request,result);
 	}
 }
-int generate_and_reply_entry(fuse_req_t request,uint64_t inode){
+int generate_entry(uint64_t inode,struct fuse_entry_param *entry){
 	sfs_inode_t inode_header;
 	int result = sfs_read_inode_header(sfs_filesystem,inode,&inode_header);
 	if (result != 0){
 		return result;
 	}
-	struct fuse_entry_param entry = {
-		.ino = inode,
-		.generation = inode_header.generation_number,
-		.attr_timeout = 1.0,
-		.entry_timeout = 1.0,
-	};
-	result = sfs_stat(inode,&entry.attr);
+	memset(entry,0,sizeof(struct fuse_entry_param));
+	entry->ino = inode;
+	entry->generation = inode_header.generation_number;
+	entry->attr_timeout = mount_options.attr_timeout;
+	entry->entry_timeout = mount_options.entry_timeout;
+	return sfs_stat(inode,&entry->attr);
+}
+int generate_and_reply_entry(fuse_req_t request,uint64_t inode){
+	struct fuse_entry_param entry;
+	int result = generate_entry(inode,&entry);
 	if (result < 0){
 		return result;
 	}
@@ -654,9 +1093,17 @@ int generate_and_reply_entry(fuse_req_t request,uint64_t inode){
 	return fuse_reply_entry(request,&entry);
 }
 static void sfs_setattr(fuse_req_t request,fuse_ino_t ino,struct stat *new_attr,int to_set,struct fuse_file_info *fi){
+	HANDLER_SCOPE(TRACE_OP_SETATTR,ino);
+	HANDLER_TRACE(flags,to_set);
+	HANDLER_TRACE(mode,new_attr->st_mode);
+	HANDLER_TRACE(size,new_attr->st_size);
 	char buffer[65];
 	bitmask_to_string(to_set,17,buffer);
-	printf("setattr called on inode %lu with to_set mask of %s\n",ino,buffer);
+	LOG_DEBUG("setattr called on inode %lu with to_set mask of %s",ino,buffer);
+	if (ino == STATS_INODE){
+		fuse_reply_err(request,EPERM);
+		return;
+	}
 	//====== read current header ======
 	sfs_inode_t headers;
 	int result = sfs_read_inode_header(sfs_filesystem,ino,&headers);
@@ -696,7 +1143,7 @@ static void sfs_setattr(fuse_req_t request,fuse_ino_t ino,struct stat *new_attr,
 		fuse_reply_err(request,errno);
 		return;
 	}
-	fuse_reply_attr(request,&attr,1.0);
+	fuse_reply_attr(request,&attr,mount_options.attr_timeout);
 }
 void bitmask_to_string(uint64_t bitmask,size_t bit_count,char buffer[65]){
 	memset(buffer,0,65);
@@ -707,79 +1154,245 @@ void bitmask_to_string(uint64_t bitmask,size_t bit_count,char buffer[65]){
 	}
 }
 static void sfs_unlink(fuse_req_t request,fuse_ino_t parent,const char *name){
+	HANDLER_SCOPE(TRACE_OP_UNLINK,parent);
+	HANDLER_TRACE_NAME(name);
+	if (is_stats_file(parent,name)){
+		fuse_reply_err(request,EPERM);
+		return;
+	}
 	sfs_inode_t headers;
 	uint64_t index;
 	//====== grab the info ======
 	uint64_t inode = inode_lookup_by_name(parent,name,&headers,&index);
 	if (inode == (uint64_t)-1){
 		//it needs to exist to be deleted
-		fuse_reply_err(request,ENOENT);
+		fuse_reply_err(request,errno);
 		return;
 	}
-
-	//====== schedule removal ======
-	//prepare data
-	struct pointer_parent_inode_trio *data = malloc(sizeof(struct pointer_parent_inode_trio));
-	data->pointer = index;
-	data->parent = parent;
-	data->inode = inode;
-	//find entry
+	if (S_ISDIR(headers.mode)){
+		fuse_reply_err(request,EISDIR);
+		return;
+	}
+	fuse_reply_err(request,orphan_dirent(parent,name,index,inode));
+}
+//only the directory entries and the headers of the inodes involved change, so renaming costs the same however big they are
+static void sfs_rename(fuse_req_t request,fuse_ino_t parent,const char *name,fuse_ino_t newparent,const char *newname,unsigned int flags){
+	//outlives the handler scope, which writes the trace record as it ends
+	char trace_name[TRACE_MAX_NAME];
+	HANDLER_SCOPE(TRACE_OP_RENAME,parent);
+	HANDLER_TRACE(offset,newparent);
+	HANDLER_TRACE(flags,flags);
+	//both names go in the record as old/new (neither can contain a /)
+	if (request_trace != NULL){
+		snprintf(trace_name,sizeof(trace_name),"%s/%s",name,newname);
+		HANDLER_TRACE_NAME(trace_name);
+	}
+	LOG_DEBUG("rename requested for [%s] under %lu to [%s] under %lu",name,parent,newname,newparent);
+	if ((flags & ~(RENAME_NOREPLACE | RENAME_EXCHANGE)) || (flags & RENAME_NOREPLACE && flags & RENAME_EXCHANGE)){
+		fuse_reply_err(request,EINVAL);
+		return;
+	}
+	if (is_stats_file(parent,name) || is_stats_file(newparent,newname)){
+		fuse_reply_err(request,EPERM);
+		return;
+	}
+	if (strlen(newname) >= SFS_MAX_FILENAME_SIZE){
+		fuse_reply_err(request,ENAMETOOLONG);
+		return;
+	}
+	//====== find both ends ======
+	sfs_inode_t headers;
+	uint64_t index;
+	uint64_t inode = inode_lookup_by_name(parent,name,&headers,&index);
+	if (inode == (uint64_t)-1){
+		fuse_reply_err(request,errno);
+		return;
+	}
+	sfs_inode_t target_headers;
+	uint64_t target_index;
+	uint64_t target = inode_lookup_by_name(newparent,newname,&target_headers,&target_index);
+	if (target == (uint64_t)-1 && errno != ENOENT){
+		fuse_reply_err(request,errno);
+		return;
+	}
+	//renaming something onto itself does nothing
+	if (target == inode){
+		fuse_reply_err(request,0);
+		return;
+	}
+	//a directory cannot end up inside itself
+	if ((S_ISDIR(headers.mode) && parent != newparent && is_ancestor(inode,newparent))
+	|| (flags & RENAME_EXCHANGE && target != (uint64_t)-1 && S_ISDIR(target_headers.mode) && parent != newparent && is_ancestor(target,parent))){
+		fuse_reply_err(request,EINVAL);
+		return;
+	}
+	//====== swap the two ======
+	if (flags & RENAME_EXCHANGE){
+		if (target == (uint64_t)-1){
+			fuse_reply_err(request,ENOENT);
+			return;
+		}
+		if (sfs_inode_exchange(sfs_filesystem,parent,index,newparent,target_index) != 0){
+			int error = errno;
+			//either side may or may not have been swapped
+			dcache_remove(dentry_cache,parent,name);
+			dcache_remove(dentry_cache,newparent,newname);
+			fuse_reply_err(request,error);
+			return;
+		}
+		dcache_insert(dentry_cache,parent,name,target);
+		dcache_insert(dentry_cache,newparent,newname,inode);
+		fuse_reply_err(request,0);
+		return;
+	}
+	//====== or replace whatever is at the new name ======
+	if (target != (uint64_t)-1){
+		if (flags & RENAME_NOREPLACE){
+			fuse_reply_err(request,EEXIST);
+			return;
+		}
+		if (S_ISDIR(headers.mode) && !S_ISDIR(target_headers.mode)){
+			fuse_reply_err(request,ENOTDIR);
+			return;
+		}
+		if (!S_ISDIR(headers.mode) && S_ISDIR(target_headers.mode)){
+			fuse_reply_err(request,EISDIR);
+			return;
+		}
+		if (S_ISDIR(target_headers.mode) && target_headers.pointer_count > 0){
+			fuse_reply_err(request,ENOTEMPTY);
+			return;
+		}
+	}
+	int result = sfs_inode_move(sfs_filesystem,inode,parent,index,newparent,(target == (uint64_t)-1) ? (uint64_t)-1 : target_index,newname);
+	if (result != 0){
+		int error = errno;
+		LOG_ERROR("sfs_inode_move: %s",strerror(error));
+		dcache_remove(dentry_cache,parent,name);
+		dcache_remove(dentry_cache,newparent,newname);
+		fuse_reply_err(request,error);
+		return;
+	}
+	dcache_insert(dentry_cache,parent,name,DCACHE_NEGATIVE);
+	dcache_insert(dentry_cache,newparent,newname,inode);
+	//====== sfs_inode_move put the replaced inode on the orphan list ======
+	if (target != (uint64_t)-1){
+		if (S_ISDIR(target_headers.mode)) dcache_remove_parent(dentry_cache,target);
+		reclaim_when_unreferenced(target);
+	}
+	sfs_update_superblock(sfs_filesystem);
+	fuse_reply_err(request,0);
+}
+//whether ancestor is inode or one of the directories above it
+int is_ancestor(uint64_t ancestor,uint64_t inode){
+	//the hop limit stops a corrupt filesystem looping forever
+	for (uint64_t hops = 0; hops <= sfs_filesystem->page_count; hops++){
+		if (inode == ancestor) return 1;
+		if (inode == FUSE_ROOT_INODE) return 0;
+		sfs_inode_t headers;
+		if (sfs_read_inode_header(sfs_filesystem,inode,&headers) != 0) return 0;
+		inode = headers.parent_inode_pointer;
+	}
+	return 0;
+}
+//====== deferred reclamation ======
+//removes the index'th entry (called name) from parent and puts its inode on the orphan list, to be freed by the reclaim thread
+//once the kernel has forgotten it (straight away if it is not referenced). returns 0 or an errno for the reply
+int orphan_dirent(uint64_t parent,const char *name,uint64_t index,uint64_t inode){
+	//====== out of the directory first ======
+	//(a crash between the two leaks the inode rather than freeing one that is still in a directory)
+	if (sfs_inode_remove_pointer(sfs_filesystem,parent,index) != 0){
+		int error = errno;
+		LOG_ERROR("sfs_inode_remove_pointer: %s",strerror(error));
+		//the directory may or may not still have it
+		dcache_remove(dentry_cache,parent,name);
+		return error;
+	}
+	dcache_insert(dentry_cache,parent,name,DCACHE_NEGATIVE);
+	return orphan_inode(inode);
+}
+//puts an inode that is in no directory any more on the orphan list and schedules it for reclaiming
+//returns 0 or an errno for the reply
+int orphan_inode(uint64_t inode){
+	if (sfs_orphan_inode(sfs_filesystem,inode) != 0){
+		int error = errno;
+		LOG_ERROR("sfs_orphan_inode: inode %lu leaked: %s",inode,strerror(error));
+		return error;
+	}
+	LOG_DEBUG("inode %lu orphaned",inode);
+	reclaim_when_unreferenced(inode);
+	return 0;
+}
+//queues an orphan for reclaiming once nothing can use it
+void reclaim_when_unreferenced(uint64_t inode){
 	struct referenced_inode match = {
 		.inode = inode
 	};
 	struct bst_node *node = bst_find_node(referenced_inodes,&match);
 	if (node == NULL){
-		//if unreferenced delete now
-		scheduled_unlink(data);
-		goto success;
+		queue_reclaim(inode);
+		return;
 	}
-	//schedule deletion
-	((struct referenced_inode *)(node->data))->destructor = scheduled_unlink;
-	((struct referenced_inode *)(node->data))->data = data;
-	
-	success:
-	//success!
-	fuse_reply_err(request,0);
+	((struct referenced_inode *)(node->data))->destructor = scheduled_reclaim;
+	((struct referenced_inode *)(node->data))->data = (void *)(uintptr_t)inode;
 }
-void scheduled_unlink(void *data){
-	//====== unpack data ======
-	struct pointer_parent_inode_trio *typed_data = data;
-	uint64_t pointer = typed_data->pointer;
-	uint64_t parent = typed_data->parent;
-	uint64_t inode = typed_data->inode;
-	printf("deleting inode %lu (regular file)\n",inode);
-
-	//====== free all pages it points to ======
-	//read headers
-	sfs_inode_t headers;
-	int result = sfs_read_inode_header(sfs_filesystem,inode,&headers);
-	if (result == 0){
-		for (uint64_t i = 0; i < headers.pointer_count; i++){
-			uint64_t pointer = sfs_inode_get_pointer(sfs_filesystem,inode,i);
-			if (pointer == (uint64_t)-1){
-				//if error occurs just skip it
-				continue;
-			}
-			sfs_free_page(sfs_filesystem,pointer);
-		}
+//destructor for an orphan's last reference
+void scheduled_reclaim(void *data){
+	queue_reclaim((uintptr_t)data);
+}
+//filesystem_lock must be held (or the reclaim thread not yet started / already stopped)
+void queue_reclaim(uint64_t inode){
+	struct pending_reclaim *reclaim = malloc(sizeof(struct pending_reclaim));
+	if (reclaim == NULL){
+		LOG_WARN("could not queue inode %lu for reclaiming, it will be reclaimed on the next mount",inode);
+		return;
 	}
-
-	//====== delete the reference in the parent ======
-	result = sfs_inode_remove_pointer(sfs_filesystem,parent,pointer);
-	if (result != 0){
-		goto end;
+	reclaim->next = NULL;
+	reclaim->inode = inode;
+	if (reclaim_queue_tail == NULL){
+		reclaim_queue_head = reclaim;
+	}else{
+		reclaim_queue_tail->next = reclaim;
 	}
-	//====== free the page ======
-	sfs_free_page(sfs_filesystem,inode);
-
-	//update superblock
-	sfs_update_superblock(sfs_filesystem);
-
-	end:
-	free(data);
+	reclaim_queue_tail = reclaim;
+	pthread_cond_signal(&reclaim_cond);
+}
+//frees the queued orphans reclaim_batch pages at a time, giving up the filesystem between batches
+//so deleting a huge file never holds up requests for long
+void *reclaim_thread(void *){
+	pthread_mutex_lock(&filesystem_lock);
+	for (;;){
+		//====== wait for something to free ======
+		for (;reclaim_queue_head == NULL && reclaim_thread_running;){
+			pthread_cond_wait(&reclaim_cond,&filesystem_lock);
+		}
+		if (!reclaim_thread_running) break; //the rest are still on the orphan list
+		//====== one batch ======
+		struct pending_reclaim *reclaim = reclaim_queue_head;
+		int result = sfs_reclaim_inode(sfs_filesystem,reclaim->inode,mount_options.reclaim_batch);
+		if (result < 0) LOG_ERROR("sfs_reclaim_inode: inode %lu: %s, leaving it for the next mount",reclaim->inode,strerror(errno));
+		if (result == 1) LOG_DEBUG("inode %lu reclaimed",reclaim->inode);
+		if (result != 0){
+			reclaim_queue_head = reclaim->next;
+			if (reclaim_queue_head == NULL) reclaim_queue_tail = NULL;
+			free(reclaim);
+		}
+		//====== let the requests that queued up behind it go first ======
+		pthread_mutex_unlock(&filesystem_lock);
+		nanosleep(&(struct timespec){.tv_sec = 0,.tv_nsec = RECLAIM_PAUSE_NS},NULL);
+		pthread_mutex_lock(&filesystem_lock);
+	}
+	pthread_mutex_unlock(&filesystem_lock);
+	return NULL;
 }
 static void sfs_open(fuse_req_t request,fuse_ino_t ino, struct fuse_file_info *fi){
-	printf("open requested on inode %lu\n",ino);
+	HANDLER_SCOPE(TRACE_OP_OPEN,ino);
+	HANDLER_TRACE(flags,fi->flags);
+	LOG_DEBUG("open requested on inode %lu",ino);
+	if (ino == STATS_INODE){
+		stats_file_open(request,fi);
+		return;
+	}
 	//====== check permitions ======
 	//read file mode
 	sfs_inode_t headers;
@@ -819,100 +1432,623 @@ static void sfs_open(fuse_req_t request,fuse_ino_t ino, struct fuse_file_info *f
 	//====== allocate an entry ======
 	int fh = table_allocate_index(open_file_table);
 	if (fh < 0){
-		perror("table_allocate_index");
+		LOG_ERROR("table_allocate_index: %s",strerror(errno));
 		fuse_reply_err(request,EMFILE);
 		return;
 	}
 	//create an open_file struct
-	struct open_file *open_file = malloc(sizeof(struct open_file));
+	struct open_file *open_file = slab_alloc(open_file_slab);
+	if (open_file == NULL){
+		table_free_index(open_file_table,fh);
+		fuse_reply_err(request,ENOMEM);
+		return;
+	}
 	memset(open_file,0,sizeof(struct open_file));
 	table_set_data(open_file_table,fh,open_file);
 	open_file->inode = ino;
 	open_file->mode = fi->flags & (O_RDONLY | O_WRONLY | O_RDWR | O_APPEND);
+	//with writeback caching the kernel works out append offsets itself
+	if (granted_capabilities & FUSE_CAP_WRITEBACK_CACHE) open_file->mode &= ~O_APPEND;
 	fi->fh = fh;
-	//directo io
-	fi->direct_io = 1;
-	//dont rely on previous cache if file opened in write mode
-	if (mode & O_WRONLY) fi->keep_cache = 0;
-	else fi->keep_cache = 0;
+	if (mount_options.kernel_cache){
+		//let the kernel serve reads from the page cache, anything we change behind its back gets invalidated
+		fi->direct_io = 0;
+		fi->keep_cache = 1;
+	}else{
+		//directo io
+		fi->direct_io = 1;
+		fi->keep_cache = 0;
+	}
 	//reference (so it cant get deleted while we hold the reference)
 	result = increase_inode_ref_count(ino,1);
 	if (result != 0){
 		fuse_reply_err(request,errno);
 		return;
 	}
-	printf("inode %lu opened with handle %d\n",ino,fh);
+	LOG_DEBUG("inode %lu opened with handle %d",ino,fh);
 	//====== reply with our stuff (that is the technical term) ======
 	fuse_reply_open(request,fi);
 }
 static void sfs_release(fuse_req_t request,fuse_ino_t ino, struct fuse_file_info *fi){
-	printf("release called on inode %lu with handle %lu\n",ino,fi->fh);
+	HANDLER_SCOPE(TRACE_OP_RELEASE,ino);
+	LOG_DEBUG("release called on inode %lu with handle %lu",ino,fi->fh);
 	//free the open_file struct
-	free(table_get_data(open_file_table,fi->fh));
+	struct open_file *open_file = table_get_data(open_file_table,fi->fh);
+	free(open_file->snapshot);
+	slab_free(open_file_slab,open_file);
 	table_free_index(open_file_table,fi->fh);
 	//unref
-	decrease_inode_ref_count(ino,1);
+	if (ino != STATS_INODE) decrease_inode_ref_count(ino,1);
+	fuse_reply_err(request,0);
+}
+struct thread_buffers *get_thread_buffers(){
+	if (current_thread_buffers == NULL){
+		current_thread_buffers = malloc(sizeof(struct thread_buffers));
+		assert(current_thread_buffers != NULL);
+		memset(current_thread_buffers,0,sizeof(struct thread_buffers));
+		//so they get freed when the thread exits
+		pthread_setspecific(thread_buffers_key,current_thread_buffers);
+	}
+	return current_thread_buffers;
+}
+void free_thread_buffers(void *data){
+	struct thread_buffers *buffers = data;
+	slab_buffer_free(&buffers->readdir);
+	slab_buffer_free(&buffers->extent_bufvec);
+	slab_buffer_free(&buffers->extents);
+	slab_buffer_free(&buffers->data);
+	slab_buffer_free(&buffers->pointers);
+	free(buffers);
+	current_thread_buffers = NULL;
+}
+//points this thread's bufvec at the given range of a file in the image, returns the byte count covered or -1 on error
+ssize_t map_file_to_bufvec(uint64_t inode,off_t offset,size_t size,struct fuse_bufvec **bufvec_return){
+	struct thread_buffers *buffers = get_thread_buffers();
+	//a range can touch at most one more page than it fills
+	size_t max_extents = size/SFS_PAGE_SIZE+2;
+	//struct fuse_bufvec has space for one buffer built in
+	if (slab_buffer_reserve(&buffers->extent_bufvec,sizeof(struct fuse_bufvec)+sizeof(struct fuse_buf)*(max_extents-1)) != 0) return -1;
+	if (slab_buffer_reserve(&buffers->extents,sizeof(struct sfs_extent)*max_extents) != 0) return -1;
+	struct fuse_bufvec *extent_bufvec = buffers->extent_bufvec.data;
+	struct sfs_extent *extent_array = buffers->extents.data;
+	ssize_t extent_count = sfs_file_map(sfs_filesystem,inode,offset,size,extent_array,max_extents);
+	if (extent_count < 0) return -1;
+	size_t total_size = 0;
+	extent_bufvec->count = extent_count;
+	extent_bufvec->idx = 0;
+	extent_bufvec->off = 0;
+	for (ssize_t i = 0; i < extent_count; i++){
+		extent_bufvec->buf[i].size = extent_array[i].len;
+		extent_bufvec->buf[i].flags = FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK | FUSE_BUF_FD_RETRY;
+		extent_bufvec->buf[i].mem = NULL;
+		extent_bufvec->buf[i].fd = sfs_filesystem->filesystem_fd;
+		extent_bufvec->buf[i].pos = extent_array[i].image_offset;
+		total_size += extent_array[i].len;
+	}
+	*bufvec_return = extent_bufvec;
+	return total_size;
+}
+//reads every pointer of an inode into this thread's pointer buffer in one go, returns NULL on error
+uint64_t *read_all_pointers(uint64_t inode,uint64_t pointer_count){
+	struct thread_buffers *buffers = get_thread_buffers();
+	if (slab_buffer_reserve(&buffers->pointers,sizeof(uint64_t)*pointer_count) != 0) return NULL;
+	if (sfs_inode_get_pointers(sfs_filesystem,inode,0,pointer_count,buffers->pointers.data) != 0) return NULL;
+	return buffers->pointers.data;
+}
+//moves the first size bytes of a mapped range between the image and this thread's data buffer through libsfs
+//returns the buffer, or NULL on error
+char *bounce_extents(struct fuse_bufvec *extent_bufvec,size_t size,int writing){
+	struct thread_buffers *buffers = get_thread_buffers();
+	if (slab_buffer_reserve(&buffers->data,size) != 0) return NULL;
+	char *data = buffers->data.data;
+	size_t done = 0;
+	for (size_t i = 0; i < extent_bufvec->count && done < size; i++){
+		size_t len = (extent_bufvec->buf[i].size < size-done) ? extent_bufvec->buf[i].size : size-done;
+		int result = writing ? sfs_image_write(sfs_filesystem,data+done,len,extent_bufvec->buf[i].pos)
+			: sfs_image_read(sfs_filesystem,data+done,len,extent_bufvec->buf[i].pos);
+		if (result != 0) return NULL;
+		done += len;
+	}
+	return data;
 }
 static void sfs_read(fuse_req_t request,fuse_ino_t ino,size_t size,off_t offset,struct fuse_file_info *fi){
-	printf("read requested on inode %lu with handle %lu\n",ino,fi->fh);
-	//====== read the data ======
-	//allocate a buffer
-	char *buffer = malloc(size);
-	memset(buffer,0,size);
-	size_t bytes_read = sfs_file_read(sfs_filesystem,ino,offset,buffer,size);
-	if (bytes_read == (size_t)-1){
+	HANDLER_SCOPE(TRACE_OP_READ,ino);
+	//(the bytes counted in the stats are the ones sent back, set just before each reply)
+	HANDLER_TRACE(offset,offset);
+	HANDLER_TRACE(size,size);
+	LOG_DEBUG("read requested on inode %lu with handle %lu",ino,fi->fh);
+	if (ino == STATS_INODE){
+		struct open_file *open_file = table_get_data(open_file_table,fi->fh);
+		if (offset >= open_file->snapshot_size) size = 0;
+		else if (offset+size > open_file->snapshot_size) size = open_file->snapshot_size-offset;
+		STATS_BYTES(size);
+		fuse_reply_buf(request,open_file->snapshot+offset,size);
+		return;
+	}
+	//====== find where the data lives in the image ======
+	struct fuse_bufvec *extent_bufvec;
+	ssize_t bytes_mapped = map_file_to_bufvec(ino,offset,size,&extent_bufvec);
+	if (bytes_mapped < 0){
 		fuse_reply_err(request,errno);
-		free(buffer);
+		return;
+	}
+	HANDLER_TRACE(result,bytes_mapped);
+	if (bytes_mapped == 0){
+		//end of file
+		fuse_reply_buf(request,NULL,0);
+		return;
+	}
+	if (mount_options.direct_io){
+		//libfuse would read the image unaligned, so libsfs reads it into memory instead
+		char *data = bounce_extents(extent_bufvec,bytes_mapped,0);
+		if (data == NULL){
+			fuse_reply_err(request,errno);
+			return;
+		}
+		sfs_account_file_io(sfs_filesystem,0,bytes_mapped,NULL,0);
+		STATS_BYTES(bytes_mapped);
+		fuse_reply_buf(request,data,bytes_mapped);
 		return;
 	}
 	//====== send of the data ======
-	fuse_reply_buf(request,buffer,bytes_read);
-	//cleanup
-	free(buffer);
+	//libfuse splices straight from the image when it can, otherwise it does the one copy itself
+	//(either way libsfs never sees the I/O, so it is told about it)
+	sfs_account_file_io(sfs_filesystem,0,bytes_mapped,get_thread_buffers()->extents.data,extent_bufvec->count);
+	enum fuse_buf_copy_flags flags = 0;
+	if (granted_capabilities & FUSE_CAP_SPLICE_MOVE) flags |= FUSE_BUF_SPLICE_MOVE;
+	STATS_BYTES(bytes_mapped);
+	fuse_reply_data(request,extent_bufvec,flags);
 }
-static void sfs_write(fuse_req_t request,fuse_ino_t ino,const char *buffer,size_t size,off_t offset,struct fuse_file_info *fi){
+static void sfs_write_buf(fuse_req_t request,fuse_ino_t ino,struct fuse_bufvec *in_buffers,off_t offset,struct fuse_file_info *fi){
+	HANDLER_SCOPE(TRACE_OP_WRITE,ino);
+	size_t size = fuse_buf_size(in_buffers);
 	//====== check for append mode ======
 	//read open modes
 	struct open_file *open_file = table_get_data(open_file_table,fi->fh);
 	if (open_file == NULL){
-		perror("table_get_data");
+		LOG_ERROR("table_get_data: %s",strerror(errno));
+		fuse_reply_err(request,errno);
+		return;
+	}
+	//the size before the write, for undoing the growth if the data never arrives
+	sfs_inode_t headers;
+	if (sfs_read_inode_header(sfs_filesystem,open_file->inode,&headers) != 0){
 		fuse_reply_err(request,errno);
+		return;
 	}
+	int offset_moved = 0;
 	if (open_file->mode & O_APPEND){
 		//set the offset to the end of the file
-		sfs_inode_t headers;
-		int result = sfs_read_inode_header(sfs_filesystem,open_file->inode,&headers);
-		if (result != 0){
-			fuse_reply_err(request,errno);
-		}
+		offset_moved = (offset != headers.size);
 		offset = headers.size;
 	}
 
-	printf("write requested on inode %lu with handle %lu\n",ino,fi->fh);
+	LOG_DEBUG("write requested on inode %lu with handle %lu",ino,fi->fh);
+	//after moving for append, so a replay writes where the data really went
+	HANDLER_TRACE(offset,offset);
+	HANDLER_TRACE(size,size);
 	//TODO: reset setuid and setgid bits
-	//====== write the data ======
-	size_t bytes_written = sfs_file_write(sfs_filesystem,ino,offset,buffer,size);
-	if (bytes_written == (size_t)-1){
+	//====== make room, then find where the data goes ======
+	if (sfs_file_grow_for_write(sfs_filesystem,ino,offset,size) != 0){
 		fuse_reply_err(request,errno);
 		return;
 	}
+	struct fuse_bufvec *extent_bufvec;
+	ssize_t bytes_mapped = map_file_to_bufvec(ino,offset,size,&extent_bufvec);
+	if (bytes_mapped < 0){
+		fuse_reply_err(request,errno);
+		return;
+	}
+	//====== write the data ======
+	ssize_t bytes_written;
+	if (mount_options.direct_io){
+		//gather the request in memory, then libsfs writes it out with aligned transfers
+		if (slab_buffer_reserve(&get_thread_buffers()->data,bytes_mapped) != 0){
+			fuse_reply_err(request,errno);
+			return;
+		}
+		struct fuse_bufvec memory_bufvec = FUSE_BUFVEC_INIT(bytes_mapped);
+		memory_bufvec.buf[0].mem = get_thread_buffers()->data.data;
+		bytes_written = fuse_buf_copy(&memory_bufvec,in_buffers,0);
+		if (bytes_written >= 0 && bounce_extents(extent_bufvec,bytes_written,1) == NULL) bytes_written = -errno;
+		if (bytes_written >= 0) sfs_account_file_io(sfs_filesystem,1,bytes_written,NULL,0);
+	}else{
+		//copies (or splices when the request came in through a pipe) straight into the image
+		enum fuse_buf_copy_flags flags = 0;
+		if (granted_capabilities & FUSE_CAP_SPLICE_MOVE) flags |= FUSE_BUF_SPLICE_MOVE;
+		bytes_written = fuse_buf_copy(extent_bufvec,in_buffers,flags);
+		if (bytes_written >= 0) sfs_account_file_io(sfs_filesystem,1,bytes_written,get_thread_buffers()->extents.data,extent_bufvec->count);
+	}
+	//====== give back what the data did not fill ======
+	//the pages past it were never written and may still hold an old file's data
+	uint64_t written_end = offset+((bytes_written > 0) ? bytes_written : 0);
+	uint64_t grown_end = offset+size;
+	if (written_end < grown_end && headers.size < grown_end){
+		uint64_t new_size = (written_end > headers.size) ? written_end : headers.size;
+		if (sfs_file_resize(sfs_filesystem,ino,new_size,-1) != 0){
+			LOG_ERROR("sfs_file_resize: could not undo growth of inode %lu: %s",ino,strerror(errno));
+		}
+	}
+	if (bytes_written < 0){
+		fuse_reply_err(request,-bytes_written);
+		return;
+	}
+	//the data did not land where the kernel thinks it did
+	if (offset_moved) queue_inval_inode(ino,0,0);
+	HANDLER_TRACE(result,bytes_written);
+	STATS_BYTES(bytes_written);
 	fuse_reply_write(request,bytes_written);
 }
 static void sfs_access(fuse_req_t request, fuse_ino_t ino, int mask){
-	printf("access called on %lu\n",ino);
+	HANDLER_SCOPE(TRACE_OP_ACCESS,ino);
+	HANDLER_TRACE(flags,mask);
+	LOG_DEBUG("access called on %lu",ino);
+	if (ino == STATS_INODE){
+		fuse_reply_err(request,(mask & (W_OK | X_OK)) ? EACCES : 0);
+		return;
+	}
 	if (!_access(ino,mask)) fuse_reply_err(request,EACCES);
 	else fuse_reply_err(request,0);
 	//else fuse_reply_none(request);
 }
 void referenced_inode_call_destructor(void *data,void *user_data){//user data is optional, and when this is called we simply pass it NULL
 	struct referenced_inode *ref_node = data;
-	printf("forgettting leftover inode %lu\n",ref_node->inode);
+	LOG_DEBUG("forgettting leftover inode %lu",ref_node->inode);
 	//call the destructor if it has not already happened
 	if (ref_node->destructor != NULL){
 		ref_node->destructor(ref_node->data);
 	}
 }
 static void sfs_forget_multi(fuse_req_t request,size_t count,struct fuse_forget_data *forgets){
-	printf("------ forget multi called\n");
+	LOG_DEBUG("------ forget multi called");
 	fuse_reply_none(request);
 }
+int parse_mount_options(char *option_string){
+	enum {
+		OPT_KERNEL_CACHE,
+		OPT_CACHE_TIMEOUT,
+		OPT_MAX_WRITE,
+		OPT_MAX_READAHEAD,
+		OPT_ASYNC_READ,
+		OPT_NO_ASYNC_READ,
+		OPT_WRITEBACK_CACHE,
+		OPT_PARALLEL_DIROPS,
+		OPT_NO_PARALLEL_DIROPS,
+		OPT_SPLICE,
+		OPT_SPLICE_READ,
+		OPT_SPLICE_WRITE,
+		OPT_SPLICE_MOVE,
+		OPT_LOG_LEVEL,
+		OPT_TRACE,
+		OPT_PUNCH_HOLES,
+		OPT_O_DIRECT,
+		OPT_RECLAIM_BATCH,
+		OPT_DENTRY_CACHE,
+	};
+	char *const tokens[] = {
+		[OPT_KERNEL_CACHE] = "kernel_cache",
+		[OPT_CACHE_TIMEOUT] = "cache_timeout",
+		[OPT_MAX_WRITE] = "max_write",
+		[OPT_MAX_READAHEAD] = "max_readahead",
+		[OPT_ASYNC_READ] = "async_read",
+		[OPT_NO_ASYNC_READ] = "no_async_read",
+		[OPT_WRITEBACK_CACHE] = "writeback_cache",
+		[OPT_PARALLEL_DIROPS] = "parallel_dirops",
+		[OPT_NO_PARALLEL_DIROPS] = "no_parallel_dirops",
+		[OPT_SPLICE] = "splice",
+		[OPT_SPLICE_READ] = "splice_read",
+		[OPT_SPLICE_WRITE] = "splice_write",
+		[OPT_SPLICE_MOVE] = "splice_move",
+		[OPT_LOG_LEVEL] = "log_level",
+		[OPT_TRACE] = "trace",
+		[OPT_PUNCH_HOLES] = "punch_holes",
+		[OPT_O_DIRECT] = "o_direct",
+		[OPT_RECLAIM_BATCH] = "reclaim_batch",
+		[OPT_DENTRY_CACHE] = "dentry_cache",
+		NULL
+	};
+	int timeout_given = 0;
+	for (;*option_string != '\0';){
+		char *value;
+		char *end;
+		switch(getsubopt(&option_string,tokens,&value)){
+			case OPT_KERNEL_CACHE:
+				mount_options.kernel_cache = 1;
+				break;
+			case OPT_CACHE_TIMEOUT:
+				if (value == NULL){
+					fprintf(stderr,"cache_timeout requires a value in seconds\n");
+					return -1;
+				}
+				mount_options.attr_timeout = strtod(value,NULL);
+				mount_options.entry_timeout = mount_options.attr_timeout;
+				timeout_given = 1;
+				break;
+			case OPT_MAX_WRITE:
+				if (parse_size(value,&mount_options.max_write) != 0){
+					fprintf(stderr,"max_write requires a size (e.g. 1M)\n");
+					return -1;
+				}
+				break;
+			case OPT_MAX_READAHEAD:
+				if (parse_size(value,&mount_options.max_readahead) != 0){
+					fprintf(stderr,"max_readahead requires a size (e.g. 1M)\n");
+					return -1;
+				}
+				break;
+			case OPT_ASYNC_READ:
+				mount_options.async_read = 1;
+				break;
+			case OPT_NO_ASYNC_READ:
+				mount_options.async_read = 0;
+				break;
+			case OPT_WRITEBACK_CACHE:
+				mount_options.writeback_cache = 1;
+				break;
+			case OPT_PARALLEL_DIROPS:
+				mount_options.parallel_dirops = 1;
+				break;
+			case OPT_NO_PARALLEL_DIROPS:
+				mount_options.parallel_dirops = 0;
+				break;
+			case OPT_SPLICE:
+				mount_options.splice_read = 1;
+				mount_options.splice_write = 1;
+				mount_options.splice_move = 1;
+				break;
+			case OPT_SPLICE_READ:
+				mount_options.splice_read = 1;
+				break;
+			case OPT_SPLICE_WRITE:
+				mount_options.splice_write = 1;
+				break;
+			case OPT_SPLICE_MOVE:
+				mount_options.splice_move = 1;
+				break;
+			case OPT_LOG_LEVEL:
+				if (value == NULL || log_parse_level(value) < 0){
+					fprintf(stderr,"log_level must be one of none, error, warn, info or debug\n");
+					return -1;
+				}
+				log_set_level(log_parse_level(value));
+				break;
+			case OPT_TRACE:
+				if (value == NULL || *value == '\0'){
+					fprintf(stderr,"trace requires a file to record to\n");
+					return -1;
+				}
+				mount_options.trace_path = value;
+				break;
+			case OPT_PUNCH_HOLES:
+				mount_options.punch_holes = 1;
+				break;
+			case OPT_O_DIRECT:
+				mount_options.direct_io = 1;
+				break;
+			case OPT_RECLAIM_BATCH:
+				mount_options.reclaim_batch = (value == NULL) ? 0 : strtoul(value,&end,10);
+				if (mount_options.reclaim_batch == 0 || *end != '\0'){
+					fprintf(stderr,"reclaim_batch requires a number of pages\n");
+					return -1;
+				}
+				break;
+			case OPT_DENTRY_CACHE:
+				if (value == NULL || *value == '\0'){
+					fprintf(stderr,"dentry_cache requires a number of entries (0 to turn it off)\n");
+					return -1;
+				}
+				mount_options.dentry_cache_size = strtoul(value,&end,10);
+				if (*end != '\0'){
+					fprintf(stderr,"dentry_cache requires a number of entries (0 to turn it off)\n");
+					return -1;
+				}
+				break;
+			default:
+				fprintf(stderr,"Unknown mount option %s\n",value);
+				return -1;
+		}
+	}
+	//long timeouts by default when caching, nothing changes behind the kernel's back without an invalidation
+	if (mount_options.kernel_cache && !timeout_given){
+		mount_options.attr_timeout = 3600.0;
+		mount_options.entry_timeout = 3600.0;
+	}
+	return 0;
+}
+//accepts a plain byte count or one with a K/M suffix
+int parse_size(const char *string,unsigned int *size_return){
+	if (string == NULL) return -1;
+	char *end;
+	unsigned long long size = strtoull(string,&end,10);
+	if (end == string) return -1;
+	switch (*end){
+		case 'k':
+		case 'K':
+			size *= 1024;
+			end++;
+			break;
+		case 'm':
+		case 'M':
+			size *= 1024*1024;
+			end++;
+			break;
+	}
+	if (*end != '\0' || size == 0 || size > UINT32_MAX) return -1;
+	*size_return = size;
+	return 0;
+}
+static void sfs_init(void *userdata,struct fuse_conn_info *connection){
+	struct {
+		unsigned int capability;
+		int wanted;
+		const char *name;
+	} capabilities[] = {
+		{FUSE_CAP_ASYNC_READ,mount_options.async_read,"async_read"},
+		{FUSE_CAP_WRITEBACK_CACHE,mount_options.writeback_cache,"writeback_cache"},
+		{FUSE_CAP_PARALLEL_DIROPS,mount_options.parallel_dirops,"parallel_dirops"},
+		{FUSE_CAP_SPLICE_READ,mount_options.splice_read,"splice_read"},
+		{FUSE_CAP_SPLICE_WRITE,mount_options.splice_write,"splice_write"},
+		{FUSE_CAP_SPLICE_MOVE,mount_options.splice_move,"splice_move"},
+	};
+	//====== request capabilities (only the ones the kernel offers) ======
+	for (size_t i = 0; i < sizeof(capabilities)/sizeof(capabilities[0]); i++){
+		if (capabilities[i].wanted && (connection->capable & capabilities[i].capability)){
+			connection->want |= capabilities[i].capability;
+		}else{
+			connection->want &= ~capabilities[i].capability;
+		}
+	}
+	//====== transfer sizes ======
+	//libfuse clamps max_write to what its buffers can take, and the kernel caps readahead to what it offered
+	connection->max_write = mount_options.max_write;
+	if (mount_options.max_readahead < connection->max_readahead){
+		connection->max_readahead = mount_options.max_readahead;
+	}
+	granted_capabilities = connection->want;
+	//====== log what we ended up with ======
+	LOG_INFO("fuse protocol %u.%u, max_write %u, max_readahead %u",connection->proto_major,connection->proto_minor,connection->max_write,connection->max_readahead);
+	for (size_t i = 0; i < sizeof(capabilities)/sizeof(capabilities[0]); i++){
+		const char *state = "off";
+		if (connection->want & capabilities[i].capability) state = "on";
+		else if (capabilities[i].wanted) state = "not supported by kernel";
+		LOG_INFO("%s: %s",capabilities[i].name,state);
+	}
+}
+static void queue_invalidation(struct pending_invalidation *invalidation){
+	pthread_mutex_lock(&invalidation_lock);
+	if (invalidation_queue_tail == NULL) invalidation_queue_head = invalidation;
+	else invalidation_queue_tail->next = invalidation;
+	invalidation_queue_tail = invalidation;
+	pthread_cond_signal(&invalidation_cond);
+	pthread_mutex_unlock(&invalidation_lock);
+}
+//offset -1 only invalidates attributes, len 0 means to the end of the file
+void queue_inval_inode(uint64_t inode,off_t offset,off_t len){
+	//nothing is cached for long enough to matter otherwise
+	if (!invalidation_thread_running) return;
+	struct pending_invalidation *invalidation = malloc(sizeof(struct pending_invalidation));
+	if (invalidation == NULL){
+		//the kernel's copy just stays stale until it times out, which is better than not answering
+		LOG_WARN("could not queue invalidation of inode %lu, dropping it",inode);
+		return;
+	}
+	memset(invalidation,0,sizeof(struct pending_invalidation));
+	invalidation->inode = inode;
+	invalidation->offset = offset;
+	invalidation->len = len;
+	queue_invalidation(invalidation);
+}
+int is_stats_file(fuse_ino_t parent,const char *name){
+	return (parent == FUSE_ROOT_INODE && strcmp(name,STATS_FILE_NAME) == 0);
+}
+void stats_file_stat(struct stat *statbuf){
+	memset(statbuf,0,sizeof(struct stat));
+	statbuf->st_ino = STATS_INODE;
+	statbuf->st_mode = S_IFREG | 0444;
+	statbuf->st_nlink = 1;
+	statbuf->st_uid = getuid();
+	statbuf->st_gid = getgid();
+	//size is left as 0, reads are direct so they carry on until the snapshot runs out
+	statbuf->st_blksize = SFS_PAGE_SIZE;
+}
+void stats_file_open(fuse_req_t request,struct fuse_file_info *fi){
+	if ((fi->flags & O_ACCMODE) != O_RDONLY){
+		fuse_reply_err(request,EACCES);
+		return;
+	}
+	int fh = table_allocate_index(open_file_table);
+	if (fh < 0){
+		fuse_reply_err(request,EMFILE);
+		return;
+	}
+	struct open_file *open_file = slab_alloc(open_file_slab);
+	if (open_file == NULL){
+		table_free_index(open_file_table,fh);
+		fuse_reply_err(request,ENOMEM);
+		return;
+	}
+	memset(open_file,0,sizeof(struct open_file));
+	open_file->inode = STATS_INODE;
+	open_file->mode = O_RDONLY;
+	//taken once so a reader sees one consistent table however small its reads are
+	open_file->snapshot = format_stats(&open_file->snapshot_size);
+	if (open_file->snapshot == NULL){
+		slab_free(open_file_slab,open_file);
+		table_free_index(open_file_table,fh);
+		fuse_reply_err(request,ENOMEM);
+		return;
+	}
+	table_set_data(open_file_table,fh,open_file);
+	fi->fh = fh;
+	fi->direct_io = 1;
+	fi->keep_cache = 0;
+	fuse_reply_open(request,fi);
+}
+//the latency table followed by libsfs's I/O amplification
+//filesystem_lock must be held, the counters are updated by every handler and the reclaim thread
+char *format_stats(size_t *size_return){
+	char *latency_table = stats_format(NULL);
+	if (latency_table == NULL) return NULL;
+	char *buffer;
+	size_t size;
+	FILE *output = open_memstream(&buffer,&size);
+	if (output == NULL){
+		free(latency_table);
+		return NULL;
+	}
+	fprintf(output,"%s\n",latency_table);
+	free(latency_table);
+	const struct dcache_stats *dentry_stats = dcache_get_stats(dentry_cache);
+	fprintf(output,"dentry cache: %lu hits, %lu negative hits, %lu misses, %lu evictions\n\n",dentry_stats->hits,dentry_stats->negative_hits,dentry_stats->misses,dentry_stats->evictions);
+	sfs_print_io_report(sfs_filesystem,output);
+	if (fclose(output) != 0){
+		free(buffer);
+		return NULL;
+	}
+	if (size_return != NULL) *size_return = size;
+	return buffer;
+}
+void *stats_dump_thread(void *){
+	sigset_t signal_set;
+	sigemptyset(&signal_set);
+	sigaddset(&signal_set,SIGUSR1);
+	for (;;){
+		int signal_number;
+		if (sigwait(&signal_set,&signal_number) != 0) continue;
+		if (!stats_dump_thread_running) break;
+		//(stats_file_open is called from a handler, which already holds it)
+		pthread_mutex_lock(&filesystem_lock);
+		char *table = format_stats(NULL);
+		pthread_mutex_unlock(&filesystem_lock);
+		if (table == NULL) continue;
+		fprintf(stderr,"====== stats ======\n%s",table);
+		fflush(stderr);
+		free(table);
+	}
+	return NULL;
+}
+void *invalidation_thread(void *){
+	pthread_mutex_lock(&invalidation_lock);
+	for (;;){
+		//====== wait for something to send ======
+		for (;invalidation_queue_head == NULL && invalidation_thread_running;){
+			pthread_cond_wait(&invalidation_cond,&invalidation_lock);
+		}
+		if (invalidation_queue_head == NULL) break; //asked to stop and nothing left
+		//====== take it off the queue ======
+		struct pending_invalidation *invalidation = invalidation_queue_head;
+		invalidation_queue_head = invalidation->next;
+		if (invalidation_queue_head == NULL) invalidation_queue_tail = NULL;
+		pthread_mutex_unlock(&invalidation_lock);
+		//====== send it (without holding the lock as this can block) ======
+		int result = fuse_lowlevel_notify_inval_inode(session,invalidation->inode,invalidation->offset,invalidation->len);
+		//ENOENT just means the kernel had nothing cached
+		if (result != 0 && result != -ENOENT){
+			LOG_WARN("cache invalidation for inode %lu failed: %s",invalidation->inode,strerror(-result));
+		}
+		free(invalidation);
+		pthread_mutex_lock(&invalidation_lock);
+	}
+	pthread_mutex_unlock(&invalidation_lock);
+	return NULL;
+}
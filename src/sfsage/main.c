@@ -0,0 +1,489 @@
+#include "../../include/sfs_functions.h"
+#include "../../include/sfs_types.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <errno.h>
+#include <endian.h>
+
+//ages an image by running a long seeded sequence of creates, grows, truncates and deletes through libsfs
+//then reports how fragmented it has become, so benchmarks can be run on something closer to a well used filesystem
+
+#define DEFAULT_FULLNESS 75
+#define DEFAULT_DIRECTORIES 16
+#define DEFAULT_CHURN 20000
+#define DEFAULT_MAX_OPERATIONS 10000000
+#define DISORDER_CHECK_INTERVAL 1000
+
+//====== types ======
+struct aged_file {
+	uint64_t inode;
+	uint64_t parent;
+	uint64_t size;
+};
+struct fragmentation_report {
+	uint64_t page_count;
+	uint64_t free_pages;
+	uint64_t files;
+	uint64_t directories;
+	//file data
+	uint64_t file_pages;
+	uint64_t file_runs; //pages that follow on directly from the one before are in the same run
+	//continuation pages of inodes (files and directories)
+	uint64_t inodes_with_continuations;
+	uint64_t continuation_pages;
+	uint64_t longest_chain;
+	//free list
+	uint64_t free_list_pages; //free_pages less the ones above the high water mark
+	uint64_t free_list_out_of_order; //steps that are not to the very next page
+	uint64_t free_list_total_jump;
+};
+enum aging_op {
+	AGING_CREATE,
+	AGING_GROW,
+	AGING_TRUNCATE,
+	AGING_DELETE,
+	AGING_OP_COUNT
+};
+
+//====== prototypes ======
+static void show_usage(char *name);
+uint64_t random_next();
+uint64_t random_below(uint64_t limit);
+uint64_t random_file_size();
+uint64_t pages_for_file(uint64_t size);
+uint64_t bytes_that_fit(uint64_t size);
+int count_free_pages(sfs_t *filesystem,uint64_t *free_pages_return,struct fragmentation_report *report);
+uint64_t next_free_page(sfs_t *filesystem,uint64_t page,uint64_t *run_length_return);
+int age_create(sfs_t *filesystem);
+int age_grow(sfs_t *filesystem);
+int age_truncate(sfs_t *filesystem);
+int age_delete(sfs_t *filesystem);
+int fragmentation_report(sfs_t *filesystem,struct fragmentation_report *report);
+int report_inode(sfs_t *filesystem,uint64_t inode,struct fragmentation_report *report,int depth);
+void print_report(struct fragmentation_report *report);
+
+//====== globals ======
+uint64_t random_state = 1;
+struct aged_file *files = NULL;
+size_t file_count = 0;
+size_t file_capacity = 0;
+uint64_t *directories = NULL;
+size_t directory_count = 0;
+uint64_t file_name_counter = 0;
+uint64_t used_pages = 0; //estimated as we go, a full count is only done for the report
+uint64_t max_file_size = 1024*1024;
+uint64_t page_count = 0;
+uint64_t limit_pages = 0; //files are not grown past this, a little over the target
+const char *aging_op_names[AGING_OP_COUNT] = {
+	[AGING_CREATE] = "create",
+	[AGING_GROW] = "grow",
+	[AGING_TRUNCATE] = "truncate",
+	[AGING_DELETE] = "delete",
+};
+
+int main(int argc,char **argv){
+	static struct option long_options[] = {
+		{"fullness",	required_argument,	0,'f'},
+		{"disorder",	required_argument,	0,'d'},
+		{"churn",	required_argument,	0,'c'},
+		{"seed",	required_argument,	0,'s'},
+		{"directories",	required_argument,	0,'D'},
+		{"max-file-size",required_argument,	0,'m'},
+		{"report",	no_argument,		0,'r'},
+		{"help",	no_argument,		0,'h'},
+		{0,		0,			0,0}
+	};
+	double target_fullness = DEFAULT_FULLNESS;
+	double target_disorder = -1;
+	uint64_t churn = DEFAULT_CHURN;
+	size_t directories_wanted = DEFAULT_DIRECTORIES;
+	int report_only = 0;
+	for (;;){
+		int option_index = 0;
+		int result = getopt_long(argc,argv,"f:d:c:s:D:m:rh",long_options,&option_index);
+		if (result == -1) break;
+		switch (result){
+			case 'f':
+				target_fullness = strtod(optarg,NULL);
+				if (target_fullness <= 0 || target_fullness >= 100){
+					fprintf(stderr,"fullness must be a percentage between 0 and 100\n");
+					return 1;
+				}
+				break;
+			case 'd':
+				target_disorder = strtod(optarg,NULL);
+				break;
+			case 'c':
+				churn = strtoull(optarg,NULL,10);
+				break;
+			case 's':
+				random_state = strtoull(optarg,NULL,10);
+				//xorshift gets stuck on 0
+				if (random_state == 0) random_state = 1;
+				break;
+			case 'D':
+				directories_wanted = strtoull(optarg,NULL,10);
+				if (directories_wanted == 0) directories_wanted = 1;
+				break;
+			case 'm':
+				max_file_size = strtoull(optarg,NULL,10);
+				if (max_file_size == 0) max_file_size = 1;
+				break;
+			case 'r':
+				report_only = 1;
+				break;
+			case 'h':
+				show_usage(argv[0]);
+				return 0;
+			default:
+				show_usage(argv[0]);
+				return 1;
+		}
+	}
+	if (argc-optind != 1){
+		show_usage(argv[0]);
+		return 1;
+	}
+	char *image_path = argv[optind];
+	sfs_t filesystem;
+	if (sfs_open_fs(&filesystem,image_path,0) != 0){
+		fprintf(stderr,"could not open %s\n",image_path);
+		return 1;
+	}
+	struct fragmentation_report report;
+	if (report_only) goto report;
+
+	//====== find out how full it already is ======
+	uint64_t free_pages;
+	if (count_free_pages(&filesystem,&free_pages,NULL) != 0){
+		fprintf(stderr,"could not read the free list: %s\n",strerror(errno));
+		sfs_close_fs(&filesystem,0);
+		return 1;
+	}
+	page_count = filesystem.page_count;
+	used_pages = page_count-free_pages;
+	uint64_t target_pages = filesystem.page_count*target_fullness/100;
+	limit_pages = target_pages+page_count/50;
+	if (limit_pages > page_count-page_count/50-16) limit_pages = page_count-page_count/50-16;
+	//====== directories to spread the files over ======
+	directories = malloc(sizeof(uint64_t)*directories_wanted);
+	if (directories == NULL) return 1;
+	for (size_t i = 0; i < directories_wanted; i++){
+		char name[SFS_MAX_FILENAME_SIZE];
+		snprintf(name,sizeof(name),"aged-%lu-%zu",random_next() % 1000000,i);
+		uint64_t directory = sfs_inode_create(&filesystem,name,S_IFDIR | 0755,getuid(),getgid(),1);
+		if (directory == (uint64_t)-1){
+			fprintf(stderr,"could not create directory %s: %s\n",name,strerror(errno));
+			sfs_close_fs(&filesystem,0);
+			return 1;
+		}
+		directories[directory_count++] = directory;
+		used_pages++;
+	}
+
+	//====== fill up to the target, then churn around it ======
+	uint64_t operations = 0, failures = 0;
+	uint64_t op_counts[AGING_OP_COUNT] = {0};
+	uint64_t churned = 0;
+	for (;operations < DEFAULT_MAX_OPERATIONS; operations++){
+		int filling = (used_pages < target_pages);
+		if (!filling){
+			if (churned >= churn){
+				//keep going until the free list is disordered enough, if that was asked for
+				if (target_disorder < 0) break;
+				if (operations % DISORDER_CHECK_INTERVAL == 0){
+					struct fragmentation_report free_list_report;
+					memset(&free_list_report,0,sizeof(free_list_report));
+					count_free_pages(&filesystem,&free_pages,&free_list_report);
+					uint64_t list_pages = free_list_report.free_list_pages;
+					if (list_pages < 2 || (double)free_list_report.free_list_out_of_order/(list_pages-1) >= target_disorder) break;
+				}
+			}
+			churned++;
+		}
+		//====== pick an operation ======
+		//below the target creates and grows win (with some shrinking mixed in), above it only shrinking happens
+		uint64_t roll = random_below(100);
+		enum aging_op op;
+		if (file_count == 0) op = AGING_CREATE;
+		else if (filling) op = (roll < 50) ? AGING_CREATE : (roll < 75) ? AGING_GROW : (roll < 90) ? AGING_TRUNCATE : AGING_DELETE;
+		else op = (roll < 45) ? AGING_TRUNCATE : AGING_DELETE;
+		int result;
+		switch (op){
+			case AGING_CREATE: result = age_create(&filesystem); break;
+			case AGING_GROW: result = age_grow(&filesystem); break;
+			case AGING_TRUNCATE: result = age_truncate(&filesystem); break;
+			default: result = age_delete(&filesystem); break;
+		}
+		op_counts[op]++;
+		if (result != 0){
+			failures++;
+			//most likely out of space, so make some
+			if (file_count > 0) age_delete(&filesystem);
+		}
+		if (operations % 10000 == 0){
+			fprintf(stderr,"\r%lu operations, %.1f%% full",operations,100.0*used_pages/filesystem.page_count);
+		}
+	}
+	fprintf(stderr,"\r");
+	printf("%lu operations (",operations);
+	for (int i = 0; i < AGING_OP_COUNT; i++) printf("%s%lu %s",(i == 0) ? "" : ", ",op_counts[i],aging_op_names[i]);
+	printf("), %lu failed\n",failures);
+
+	report:
+	if (fragmentation_report(&filesystem,&report) != 0){
+		fprintf(stderr,"could not walk the filesystem: %s\n",strerror(errno));
+		sfs_close_fs(&filesystem,0);
+		return 1;
+	}
+	print_report(&report);
+	free(files);
+	free(directories);
+	return (sfs_close_fs(&filesystem,0) != 0);
+}
+static void show_usage(char *name){
+	printf("usage: %s [options] <filesystem image>\n",name);
+	printf("ages the image in place, make a copy first if the fresh one is still wanted\n");
+	printf(" -f / --fullness <percent> : fill the image to this much (default %d)\n",DEFAULT_FULLNESS);
+	printf(" -c / --churn <n> : operations to run once full, deleting about as much as is created (default %d)\n",DEFAULT_CHURN);
+	printf(" -d / --disorder <fraction> : keep churning until at least this fraction of the free list is out of order\n");
+	printf(" -s / --seed <n> : seed for the operation sequence, the same seed on the same image ages it the same way (default 1)\n");
+	printf(" -D / --directories <n> : directories to spread files over (default %d)\n",DEFAULT_DIRECTORIES);
+	printf(" -m / --max-file-size <bytes> : largest file to create (default 1048576)\n");
+	printf(" -r / --report : only report on the image, without aging it\n");
+}
+
+//====== random numbers ======
+//xorshift64*, so a seed gives the same sequence whatever libc is in use
+uint64_t random_next(){
+	random_state ^= random_state >> 12;
+	random_state ^= random_state << 25;
+	random_state ^= random_state >> 27;
+	return random_state*0x2545F4914F6CDD1DULL;
+}
+uint64_t random_below(uint64_t limit){
+	if (limit == 0) return 0;
+	return random_next() % limit;
+}
+//mostly small files with the odd big one
+uint64_t random_file_size(){
+	uint64_t roll = random_below(100);
+	uint64_t size;
+	if (roll < 70) size = random_below(4*1024);
+	else if (roll < 95) size = 4*1024+random_below(60*1024);
+	else size = 64*1024+random_below(max_file_size);
+	return (size > max_file_size) ? max_file_size : size;
+}
+//data pages plus the inode and its continuation pages
+uint64_t pages_for_file(uint64_t size){
+	uint64_t data_pages = (size+SFS_PAGE_SIZE-1)/SFS_PAGE_SIZE;
+	uint64_t inode_pages = (data_pages == 0) ? 1 : (data_pages+SFS_INODE_MAX_POINTERS-1)/SFS_INODE_MAX_POINTERS;
+	return data_pages+inode_pages;
+}
+//the largest size up to the one given that a file can grow by without going past limit_pages
+//(so the big files that fit comfortably on a large image do not overshoot the target on a small one)
+uint64_t bytes_that_fit(uint64_t size){
+	if (used_pages+1 >= limit_pages) return 0;
+	uint64_t spare_pages = limit_pages-used_pages-1;
+	uint64_t spare_bytes = spare_pages*SFS_PAGE_SIZE*SFS_INODE_MAX_POINTERS/(SFS_INODE_MAX_POINTERS+1);
+	return (size > spare_bytes) ? spare_bytes : size;
+}
+
+//====== free list ======
+//free pages start with a type byte and then the next free page, followed by the length for a run of them
+uint64_t next_free_page(sfs_t *filesystem,uint64_t page,uint64_t *run_length_return){
+	uint8_t header[SFS_FREE_RUN_HEADER_SIZE];
+	if (pread(filesystem->filesystem_fd,header,sizeof(header),sfs_page_offset(filesystem,page)) != sizeof(header)) return (uint64_t)-1;
+	uint64_t next, run_length = 1;
+	memcpy(&next,header+1,sizeof(next));
+	if (header[0] == SFS_FREE_RUN_IDENTIFIER){
+		memcpy(&run_length,header+1+sizeof(next),sizeof(run_length));
+		run_length = be64toh(run_length);
+	}
+	*run_length_return = run_length;
+	return be64toh(next);
+}
+//walks the whole free list, filling in the free list part of the report if one is given
+int count_free_pages(sfs_t *filesystem,uint64_t *free_pages_return,struct fragmentation_report *report){
+	//the pages libsfs is holding in memory are not on the list until they are flushed
+	if (sfs_flush_free_pages(filesystem) != 0) return -1;
+	uint64_t free_pages = 0;
+	for (uint64_t page = filesystem->first_free_page_index; page != (uint64_t)-1;){
+		uint64_t run_length = 0;
+		uint64_t next = (page < filesystem->page_count) ? next_free_page(filesystem,page,&run_length) : (uint64_t)-1;
+		if (run_length == 0 || run_length > filesystem->page_count-page || free_pages > filesystem->page_count){
+			//a broken or looping list
+			errno = EFAULT;
+			return -1;
+		}
+		free_pages += run_length;
+		//the steps inside a run are all to the very next page
+		uint64_t last = page+run_length-1;
+		if (report != NULL) report->free_list_total_jump += run_length-1;
+		if (report != NULL && next != (uint64_t)-1){
+			if (next != last+1) report->free_list_out_of_order++;
+			report->free_list_total_jump += (next > last) ? next-last : last-next;
+		}
+		page = next;
+	}
+	if (report != NULL) report->free_list_pages = free_pages;
+	//and the pages that have never been used
+	*free_pages_return = free_pages+filesystem->page_count-filesystem->high_water_mark;
+	return 0;
+}
+
+//====== aging operations ======
+int age_create(sfs_t *filesystem){
+	if (file_count >= file_capacity){
+		size_t new_capacity = (file_capacity == 0) ? 1024 : file_capacity*2;
+		struct aged_file *new_files = realloc(files,sizeof(struct aged_file)*new_capacity);
+		if (new_files == NULL) return -1;
+		files = new_files;
+		file_capacity = new_capacity;
+	}
+	char name[SFS_MAX_FILENAME_SIZE];
+	snprintf(name,sizeof(name),"f%lu",file_name_counter++);
+	uint64_t parent = directories[random_below(directory_count)];
+	uint64_t inode = sfs_inode_create(filesystem,name,S_IFREG | 0644,getuid(),getgid(),parent);
+	if (inode == (uint64_t)-1) return -1;
+	struct aged_file *file = &files[file_count++];
+	file->inode = inode;
+	file->parent = parent;
+	file->size = 0;
+	used_pages += pages_for_file(0);
+	uint64_t size = bytes_that_fit(random_file_size());
+	if (size == 0) return 0;
+	if (sfs_file_resize(filesystem,inode,size,-1) != 0) return -1;
+	used_pages += pages_for_file(size)-pages_for_file(0);
+	file->size = size;
+	return 0;
+}
+int age_grow(sfs_t *filesystem){
+	struct aged_file *file = &files[random_below(file_count)];
+	uint64_t new_size = file->size+bytes_that_fit(1+random_below(16*1024));
+	if (new_size == file->size || new_size > max_file_size) return 0;
+	if (sfs_file_resize(filesystem,file->inode,new_size,-1) != 0) return -1;
+	used_pages += pages_for_file(new_size)-pages_for_file(file->size);
+	file->size = new_size;
+	return 0;
+}
+int age_truncate(sfs_t *filesystem){
+	struct aged_file *file = &files[random_below(file_count)];
+	if (file->size == 0) return 0;
+	uint64_t new_size = random_below(file->size);
+	if (sfs_file_resize(filesystem,file->inode,new_size,-1) != 0) return -1;
+	used_pages -= pages_for_file(file->size)-pages_for_file(new_size);
+	file->size = new_size;
+	return 0;
+}
+int age_delete(sfs_t *filesystem){
+	size_t index = random_below(file_count);
+	struct aged_file *file = &files[index];
+	//====== free the data, then any continuation pages left behind ======
+	if (sfs_file_resize(filesystem,file->inode,0,-1) != 0) return -1;
+	sfs_inode_t header;
+	if (sfs_read_inode_header(filesystem,file->inode,&header) != 0) return -1;
+	for (uint64_t page = header.next_page; page != (uint64_t)-1;){
+		sfs_inode_t continuation;
+		if (sfs_read_inode_header(filesystem,page,&continuation) != 0) return -1;
+		sfs_free_page(filesystem,page);
+		page = continuation.next_page;
+	}
+	//====== take it out of its directory ======
+	sfs_inode_t parent_header;
+	if (sfs_read_inode_header(filesystem,file->parent,&parent_header) != 0) return -1;
+	uint64_t *children = malloc(sizeof(uint64_t)*(parent_header.pointer_count+1));
+	if (children == NULL) return -1;
+	if (sfs_inode_get_pointers(filesystem,file->parent,0,parent_header.pointer_count,children) != 0){
+		free(children);
+		return -1;
+	}
+	for (uint64_t i = 0; i < parent_header.pointer_count; i++){
+		if (children[i] == file->inode){
+			if (sfs_inode_remove_pointer(filesystem,file->parent,i) != 0){
+				free(children);
+				return -1;
+			}
+			break;
+		}
+	}
+	free(children);
+	if (sfs_free_page(filesystem,file->inode) != 0) return -1;
+	used_pages -= pages_for_file(file->size);
+	//====== swap the last file into its place ======
+	files[index] = files[--file_count];
+	return 0;
+}
+
+//====== reporting ======
+int fragmentation_report(sfs_t *filesystem,struct fragmentation_report *report){
+	memset(report,0,sizeof(struct fragmentation_report));
+	report->page_count = filesystem->page_count;
+	if (count_free_pages(filesystem,&report->free_pages,report) != 0) return -1;
+	return report_inode(filesystem,1,report,0);
+}
+//adds the inode (and everything under it if it is a directory) to the report
+int report_inode(sfs_t *filesystem,uint64_t inode,struct fragmentation_report *report,int depth){
+	sfs_inode_t header;
+	if (sfs_read_inode_header(filesystem,inode,&header) != 0) return -1;
+	//====== continuation chain ======
+	uint64_t chain_length = 0;
+	for (uint64_t page = header.next_page; page != (uint64_t)-1 && chain_length <= filesystem->page_count; chain_length++){
+		sfs_inode_t continuation;
+		if (sfs_read_inode_header(filesystem,page,&continuation) != 0) return -1;
+		page = continuation.next_page;
+	}
+	if (chain_length > 0) report->inodes_with_continuations++;
+	report->continuation_pages += chain_length;
+	if (chain_length > report->longest_chain) report->longest_chain = chain_length;
+	//====== what it points to ======
+	if (S_ISDIR(header.mode)){
+		report->directories++;
+		//only a corrupt image could nest this deep (a directory inside itself)
+		if (depth > 64) return 0;
+	}
+	//====== read every pointer at once ======
+	uint64_t *pointers = malloc(sizeof(uint64_t)*(header.pointer_count+1));
+	if (pointers == NULL) return -1;
+	if (sfs_inode_get_pointers(filesystem,inode,0,header.pointer_count,pointers) != 0){
+		free(pointers);
+		return -1;
+	}
+	int result = 0;
+	if (S_ISDIR(header.mode)){
+		for (uint64_t i = 0; i < header.pointer_count && result == 0; i++){
+			result = report_inode(filesystem,pointers[i],report,depth+1);
+		}
+		free(pointers);
+		return result;
+	}
+	report->files++;
+	uint64_t previous = (uint64_t)-1;
+	for (uint64_t i = 0; i < header.pointer_count; i++){
+		uint64_t page = pointers[i];
+		if (previous == (uint64_t)-1 || page != previous+1) report->file_runs++;
+		report->file_pages++;
+		previous = page;
+	}
+	free(pointers);
+	return 0;
+}
+void print_report(struct fragmentation_report *report){
+	uint64_t used = report->page_count-report->free_pages;
+	printf("%-28s %lu\n","pages",report->page_count);
+	printf("%-28s %lu (%.1f%%)\n","used pages",used,100.0*used/report->page_count);
+	printf("%-28s %lu\n","files",report->files);
+	printf("%-28s %lu\n","directories",report->directories);
+	printf("%-28s %lu in %lu runs, %.2f pages per run\n","file pages",report->file_pages,report->file_runs,
+		(report->file_runs == 0) ? 0.0 : (double)report->file_pages/report->file_runs);
+	printf("%-28s %lu pages over %lu inodes, longest %lu\n","continuation pages",report->continuation_pages,report->inodes_with_continuations,report->longest_chain);
+	printf("%-28s %lu\n","never used pages",report->free_pages-report->free_list_pages);
+	uint64_t steps = (report->free_list_pages == 0) ? 0 : report->free_list_pages-1;
+	printf("%-28s %lu of %lu steps out of order (%.1f%%), mean jump %.1f pages\n","free list",report->free_list_out_of_order,steps,
+		(steps == 0) ? 0.0 : 100.0*report->free_list_out_of_order/steps,
+		(steps == 0) ? 0.0 : (double)report->free_list_total_jump/steps);
+}
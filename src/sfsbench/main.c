@@ -0,0 +1,398 @@
+#include "../../include/sfs_functions.h"
+#include "../../include/sfs_types.h"
+#include "../libbst/libbst.h"
+#include "../libtable/libtable.h"
+#include "../libstats/libstats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <errno.h>
+
+//microbenchmarks for libsfs and the data structure libraries
+//every call being measured is timed on its own, so the percentiles are exact
+
+#define DEFAULT_PAGE_COUNT 32768
+#define FILE_REGION_SIZE (8*1024*1024) //file benchmarks wrap around within this much of the file
+
+//====== types ======
+struct bench_result {
+	const char *name;
+	char param[32];
+	size_t iterations;
+	size_t capacity;
+	uint64_t total_ns;
+	uint64_t *samples;
+};
+enum output_format {
+	FORMAT_CSV,
+	FORMAT_JSON,
+};
+
+//====== prototypes ======
+static void show_usage(char *name);
+int create_image(const char *path,sfs_t *filesystem,uint64_t page_count);
+struct bench_result *result_new(const char *name,const char *param,size_t capacity);
+void result_add(struct bench_result *result,uint64_t elapsed_ns);
+void result_print(struct bench_result *result);
+void result_free(struct bench_result *result);
+int compare_u64(const void *a,const void *b);
+void bench_pages(sfs_t *filesystem);
+void bench_get_pointer(sfs_t *filesystem);
+void bench_add_pointer(sfs_t *filesystem);
+void bench_file_io(sfs_t *filesystem);
+void bench_bst();
+void bench_table();
+
+//====== globals ======
+enum output_format output_format = FORMAT_CSV;
+size_t iteration_scale = 1;
+int results_printed = 0;
+
+int main(int argc,char **argv){
+	static struct option long_options[] = {
+		{"image",	required_argument,	0,'i'},
+		{"pages",	required_argument,	0,'p'},
+		{"json",	no_argument,		0,'j'},
+		{"scale",	required_argument,	0,'n'},
+		{"help",	no_argument,		0,'h'},
+		{0,		0,			0,0}
+	};
+	char *image_path = "sfsbench.img";
+	uint64_t page_count = DEFAULT_PAGE_COUNT;
+	for (;;){
+		int option_index = 0;
+		int result = getopt_long(argc,argv,"i:p:jn:h",long_options,&option_index);
+		if (result == -1) break;
+		switch (result){
+			case 'i':
+				image_path = optarg;
+				break;
+			case 'p':
+				page_count = strtoull(optarg,NULL,10);
+				break;
+			case 'j':
+				output_format = FORMAT_JSON;
+				break;
+			case 'n':
+				iteration_scale = strtoull(optarg,NULL,10);
+				if (iteration_scale < 1) iteration_scale = 1;
+				break;
+			case 'h':
+				show_usage(argv[0]);
+				return 0;
+			default:
+				show_usage(argv[0]);
+				return 1;
+		}
+	}
+	//====== scratch image ======
+	sfs_t filesystem;
+	if (create_image(image_path,&filesystem,page_count) != 0){
+		fprintf(stderr,"could not create %s: %s\n",image_path,strerror(errno));
+		return 1;
+	}
+
+	//====== run everything ======
+	if (output_format == FORMAT_CSV) printf("benchmark,param,iterations,ops_per_sec,mean_ns,p50_ns,p99_ns,p999_ns,max_ns\n");
+	else printf("[\n");
+	bench_pages(&filesystem);
+	bench_get_pointer(&filesystem);
+	bench_add_pointer(&filesystem);
+	bench_file_io(&filesystem);
+	bench_bst();
+	bench_table();
+	if (output_format == FORMAT_JSON) printf("\n]\n");
+
+	sfs_close_fs(&filesystem,0);
+	unlink(image_path);
+	return 0;
+}
+static void show_usage(char *name){
+	printf("usage: %s [options]\n",name);
+	printf(" -i / --image <path> : scratch image to create (removed afterwards, default sfsbench.img)\n");
+	printf(" -p / --pages <count> : size of the scratch image in pages (default %d)\n",DEFAULT_PAGE_COUNT);
+	printf(" -n / --scale <n> : multiply every iteration count by n\n");
+	printf(" -j / --json : print json instead of csv\n");
+}
+//the same layout mkfs.sfs makes: a root directory at page 1 and every other page free
+int create_image(const char *path,sfs_t *filesystem,uint64_t page_count){
+	unlink(path);
+	return sfs_create_fs(filesystem,path,page_count,0);
+}
+
+//====== results ======
+struct bench_result *result_new(const char *name,const char *param,size_t capacity){
+	struct bench_result *result = malloc(sizeof(struct bench_result));
+	if (result == NULL) return NULL;
+	memset(result,0,sizeof(struct bench_result));
+	result->name = name;
+	strncpy(result->param,param,sizeof(result->param)-1);
+	result->capacity = capacity;
+	result->samples = malloc(sizeof(uint64_t)*capacity);
+	if (result->samples == NULL){
+		free(result);
+		return NULL;
+	}
+	return result;
+}
+void result_add(struct bench_result *result,uint64_t elapsed_ns){
+	if (result->iterations >= result->capacity) return;
+	result->samples[result->iterations++] = elapsed_ns;
+	result->total_ns += elapsed_ns;
+}
+int compare_u64(const void *a,const void *b){
+	uint64_t value_a = *(const uint64_t *)a;
+	uint64_t value_b = *(const uint64_t *)b;
+	return (value_a > value_b)-(value_a < value_b);
+}
+void result_print(struct bench_result *result){
+	if (result->iterations == 0) return;
+	qsort(result->samples,result->iterations,sizeof(uint64_t),compare_u64);
+	size_t count = result->iterations;
+	double ops_per_sec = (result->total_ns == 0) ? 0 : count/(result->total_ns/1e9);
+	uint64_t mean = result->total_ns/count;
+	uint64_t p50 = result->samples[count*500/1000];
+	uint64_t p99 = result->samples[count*990/1000];
+	uint64_t p999 = result->samples[count*999/1000];
+	uint64_t max = result->samples[count-1];
+	if (output_format == FORMAT_CSV){
+		printf("%s,%s,%zu,%.0f,%lu,%lu,%lu,%lu,%lu\n",result->name,result->param,count,ops_per_sec,mean,p50,p99,p999,max);
+	}else{
+		printf("%s  {\"benchmark\": \"%s\", \"param\": \"%s\", \"iterations\": %zu, \"ops_per_sec\": %.0f, \"mean_ns\": %lu, \"p50_ns\": %lu, \"p99_ns\": %lu, \"p999_ns\": %lu, \"max_ns\": %lu}",
+			results_printed ? ",\n" : "",result->name,result->param,count,ops_per_sec,mean,p50,p99,p999,max);
+	}
+	results_printed++;
+	fflush(stdout);
+}
+void result_free(struct bench_result *result){
+	free(result->samples);
+	free(result);
+}
+
+//====== libsfs ======
+void bench_pages(sfs_t *filesystem){
+	size_t iterations = 10000*iteration_scale;
+	struct bench_result *allocate = result_new("sfs_allocate_page","-",iterations);
+	struct bench_result *free_page = result_new("sfs_free_page","-",iterations);
+	uint64_t *pages = malloc(sizeof(uint64_t)*iterations);
+	if (allocate == NULL || free_page == NULL || pages == NULL){
+		fprintf(stderr,"bench_pages: out of memory\n");
+		exit(1);
+	}
+	size_t allocated = 0;
+	for (; allocated < iterations; allocated++){
+		uint64_t start = stats_now();
+		pages[allocated] = sfs_allocate_page(filesystem);
+		result_add(allocate,stats_now()-start);
+		if (pages[allocated] == (uint64_t)-1) break;
+	}
+	for (size_t i = 0; i < allocated; i++){
+		uint64_t start = stats_now();
+		sfs_free_page(filesystem,pages[i]);
+		result_add(free_page,stats_now()-start);
+	}
+	result_print(allocate);
+	result_print(free_page);
+	result_free(allocate);
+	result_free(free_page);
+	free(pages);
+}
+void bench_get_pointer(sfs_t *filesystem){
+	//a directory long enough to need a long chain of continuation pages
+	uint64_t pointer_count = 20000;
+	uint64_t directory = sfs_inode_create(filesystem,"get_pointer",S_IFDIR | 0755,getuid(),getgid(),1);
+	if (directory == (uint64_t)-1 || sfs_inode_realocate_pointers(filesystem,directory,pointer_count) != 0){
+		fprintf(stderr,"bench_get_pointer: could not build directory: %s\n",strerror(errno));
+		return;
+	}
+	uint64_t indexes[] = {0,SFS_INODE_MAX_POINTERS-1,1000,10000,pointer_count-1};
+	for (size_t i = 0; i < sizeof(indexes)/sizeof(indexes[0]); i++){
+		char param[32];
+		snprintf(param,sizeof(param),"index=%lu",indexes[i]);
+		size_t iterations = 1000*iteration_scale;
+		struct bench_result *result = result_new("sfs_inode_get_pointer",param,iterations);
+		if (result == NULL) return;
+		for (size_t j = 0; j < iterations; j++){
+			uint64_t start = stats_now();
+			sfs_inode_get_pointer(filesystem,directory,indexes[i]);
+			result_add(result,stats_now()-start);
+		}
+		result_print(result);
+		result_free(result);
+	}
+	//====== the whole directory, one pointer at a time and all at once ======
+	uint64_t *pointers = malloc(sizeof(uint64_t)*pointer_count);
+	if (pointers == NULL) return;
+	size_t iterations = iteration_scale;
+	struct bench_result *single = result_new("sfs_inode_get_pointer","scan",iterations);
+	struct bench_result *range = result_new("sfs_inode_get_pointers","scan",iterations);
+	if (single != NULL && range != NULL){
+		for (size_t j = 0; j < iterations; j++){
+			uint64_t start = stats_now();
+			for (uint64_t i = 0; i < pointer_count; i++) pointers[i] = sfs_inode_get_pointer(filesystem,directory,i);
+			result_add(single,stats_now()-start);
+			start = stats_now();
+			sfs_inode_get_pointers(filesystem,directory,0,pointer_count,pointers);
+			result_add(range,stats_now()-start);
+		}
+		result_print(single);
+		result_print(range);
+	}
+	if (single != NULL) result_free(single);
+	if (range != NULL) result_free(range);
+	free(pointers);
+}
+void bench_add_pointer(sfs_t *filesystem){
+	//grow one directory and time the adds that land in each window of sizes
+	uint64_t windows[] = {0,1000,10000};
+	size_t window_size = 100*iteration_scale;
+	uint64_t directory = sfs_inode_create(filesystem,"add_pointer",S_IFDIR | 0755,getuid(),getgid(),1);
+	if (directory == (uint64_t)-1){
+		fprintf(stderr,"bench_add_pointer: could not create directory: %s\n",strerror(errno));
+		return;
+	}
+	uint64_t size = 0;
+	for (size_t i = 0; i < sizeof(windows)/sizeof(windows[0]); i++){
+		//untimed growth up to the window
+		for (;size < windows[i]; size++){
+			if (sfs_inode_add_pointer(filesystem,directory,size) != 0) return;
+		}
+		char param[32];
+		snprintf(param,sizeof(param),"entries=%lu",windows[i]);
+		struct bench_result *result = result_new("sfs_inode_add_pointer",param,window_size);
+		if (result == NULL) return;
+		for (size_t j = 0; j < window_size; j++, size++){
+			uint64_t start = stats_now();
+			int failed = sfs_inode_add_pointer(filesystem,directory,size);
+			result_add(result,stats_now()-start);
+			if (failed) break;
+		}
+		result_print(result);
+		result_free(result);
+	}
+}
+void bench_file_io(sfs_t *filesystem){
+	size_t sizes[] = {512,4096,65536,1024*1024};
+	size_t iterations[] = {2000,2000,200,50};
+	char *buffer = malloc(1024*1024);
+	if (buffer == NULL) return;
+	memset(buffer,'x',1024*1024);
+	for (size_t i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++){
+		char name[32];
+		snprintf(name,sizeof(name),"file_%zu",sizes[i]);
+		uint64_t file = sfs_inode_create(filesystem,name,S_IFREG | 0644,getuid(),getgid(),1);
+		if (file == (uint64_t)-1){
+			fprintf(stderr,"bench_file_io: could not create file: %s\n",strerror(errno));
+			break;
+		}
+		char param[32];
+		snprintf(param,sizeof(param),"size=%zu",sizes[i]);
+		size_t count = iterations[i]*iteration_scale;
+		struct bench_result *write_result = result_new("sfs_file_write",param,count);
+		struct bench_result *read_result = result_new("sfs_file_read",param,count);
+		if (write_result == NULL || read_result == NULL) break;
+		//the first lap of the region also grows the file, so writes include allocation
+		for (size_t j = 0; j < count; j++){
+			off_t offset = (j*sizes[i])%FILE_REGION_SIZE;
+			uint64_t start = stats_now();
+			size_t result = sfs_file_write(filesystem,file,offset,buffer,sizes[i]);
+			result_add(write_result,stats_now()-start);
+			if (result == (size_t)-1) break;
+		}
+		for (size_t j = 0; j < count; j++){
+			off_t offset = (j*sizes[i])%FILE_REGION_SIZE;
+			uint64_t start = stats_now();
+			size_t result = sfs_file_read(filesystem,file,offset,buffer,sizes[i]);
+			result_add(read_result,stats_now()-start);
+			if (result == (size_t)-1) break;
+		}
+		result_print(write_result);
+		result_print(read_result);
+		result_free(write_result);
+		result_free(read_result);
+		//give the pages back for the next size
+		sfs_file_resize(filesystem,file,0,-1);
+	}
+	free(buffer);
+}
+
+//====== libbst ======
+int bench_bst_cmp(void *a,void *b){
+	uint64_t value_a = *(uint64_t *)a;
+	uint64_t value_b = *(uint64_t *)b;
+	return (value_b > value_a)-(value_b < value_a);
+}
+void bench_bst(){
+	size_t count = 10000*iteration_scale;
+	struct bst_user_functions functions = {
+		.datacmp = bench_bst_cmp,
+		.free_data = NULL,
+		.print_data = NULL
+	};
+	BST *bst = bst_new(&functions);
+	uint64_t *keys = malloc(sizeof(uint64_t)*count);
+	struct bench_result *insert = result_new("bst_new_node","random",count);
+	struct bench_result *find = result_new("bst_find_node","random",count);
+	struct bench_result *delete = result_new("bst_delete_node","random",count);
+	if (keys == NULL || insert == NULL || find == NULL || delete == NULL) return;
+	//seeded so every run builds the same tree
+	srandom(1);
+	for (size_t i = 0; i < count; i++) keys[i] = ((uint64_t)random() << 31) | random();
+	for (size_t i = 0; i < count; i++){
+		uint64_t start = stats_now();
+		bst_new_node(bst,&keys[i]);
+		result_add(insert,stats_now()-start);
+	}
+	for (size_t i = 0; i < count; i++){
+		uint64_t start = stats_now();
+		bst_find_node(bst,&keys[(i*7919)%count]);
+		result_add(find,stats_now()-start);
+	}
+	//deleting can move data between nodes, so each key is looked up again
+	for (size_t i = 0; i < count; i++){
+		uint64_t start = stats_now();
+		struct bst_node *node = bst_find_node(bst,&keys[i]);
+		if (node != NULL) bst_delete_node(bst,node);
+		result_add(delete,stats_now()-start);
+	}
+	result_print(insert);
+	result_print(find);
+	result_print(delete);
+	result_free(insert);
+	result_free(find);
+	result_free(delete);
+	bst_delete(bst);
+	free(keys);
+}
+
+//====== libtable ======
+void bench_table(){
+	size_t table_size = 1024;
+	size_t rounds = 10*iteration_scale;
+	TABLE *table = table_new(table_size);
+	int *indexes = malloc(sizeof(int)*table_size);
+	struct bench_result *allocate = result_new("table_allocate_index","size=1024",table_size*rounds);
+	struct bench_result *free_index = result_new("table_free_index","size=1024",table_size*rounds);
+	if (table == NULL || indexes == NULL || allocate == NULL || free_index == NULL) return;
+	for (size_t round = 0; round < rounds; round++){
+		for (size_t i = 0; i < table_size; i++){
+			uint64_t start = stats_now();
+			indexes[i] = table_allocate_index(table);
+			result_add(allocate,stats_now()-start);
+		}
+		for (size_t i = 0; i < table_size; i++){
+			uint64_t start = stats_now();
+			table_free_index(table,indexes[i]);
+			result_add(free_index,stats_now()-start);
+		}
+	}
+	result_print(allocate);
+	result_print(free_index);
+	result_free(allocate);
+	result_free(free_index);
+	table_delete(table);
+	free(indexes);
+}
@@ -0,0 +1,432 @@
+#include "../../include/sfs_functions.h"
+#include "../../include/sfs_types.h"
+#include "../libtrace/libtrace.h"
+#include "../libstats/libstats.h"
+#include "../libdcache/libdcache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+
+//replays a request trace recorded by mountsfs -o trace=FILE straight against libsfs
+//the image is copied first, so the same trace can be replayed against the same starting point again and again
+
+//the hidden stats file in mountsfs, requests on it never touched the image
+#define STATS_INODE ((uint64_t)-2)
+//the bits of the setattr to_set mask that the replay acts on (same values as FUSE_SET_ATTR_*)
+#define SETATTR_MODE (1 << 0)
+#define SETATTR_SIZE (1 << 3)
+//the renameat2 flag that swaps rather than replaces (the same as mountsfs)
+#ifndef RENAME_EXCHANGE
+#define RENAME_EXCHANGE (1 << 1)
+#endif
+#define INODE_MAP_INITIAL_SIZE 1024
+//the same as mountsfs's default dentry_cache
+#define DENTRY_CACHE_SIZE 16384
+
+//====== types ======
+//inodes created during the replay need not land on the same pages they did when recorded
+struct inode_map_entry {
+	uint64_t recorded;
+	uint64_t replayed;
+};
+struct inode_map {
+	struct inode_map_entry *entries;
+	size_t size; //always a power of 2
+	size_t used;
+};
+
+//====== prototypes ======
+static void show_usage(char *name);
+int copy_image(const char *source,const char *destination);
+int replay_record(sfs_t *filesystem,struct trace_record *record,const char *name,char **buffer,size_t *buffer_size);
+uint64_t *read_all_pointers(sfs_t *filesystem,uint64_t inode,uint64_t pointer_count);
+uint64_t lookup_by_name(sfs_t *filesystem,uint64_t parent,const char *name,uint64_t *pointer_index_return);
+int remove_inode(sfs_t *filesystem,uint64_t parent,const char *name);
+int rename_inode(sfs_t *filesystem,uint64_t parent,const char *name,uint64_t new_parent,const char *new_name,unsigned int flags);
+uint64_t inode_map_get(uint64_t recorded);
+int inode_map_set(uint64_t recorded,uint64_t replayed);
+void wait_until(uint64_t start,uint64_t offset_ns);
+
+//====== globals ======
+struct inode_map inode_map = {
+	.entries = NULL,
+	.size = 0,
+	.used = 0,
+};
+//reused by read_all_pointers
+uint64_t *pointer_buffer = NULL;
+size_t pointer_buffer_size = 0;
+//lookups hit and miss it as they would have in mountsfs
+DCACHE *dentry_cache = NULL;
+
+int main(int argc,char **argv){
+	static struct option long_options[] = {
+		{"output",	required_argument,	0,'o'},
+		{"paced",	no_argument,		0,'p'},
+		{"speed",	required_argument,	0,'s'},
+		{"keep",	no_argument,		0,'k'},
+		{"help",	no_argument,		0,'h'},
+		{0,		0,			0,0}
+	};
+	char *copy_path = NULL;
+	int paced = 0;
+	double speed = 1.0;
+	int keep = 0;
+	for (;;){
+		int option_index = 0;
+		int result = getopt_long(argc,argv,"o:ps:kh",long_options,&option_index);
+		if (result == -1) break;
+		switch (result){
+			case 'o':
+				copy_path = optarg;
+				break;
+			case 'p':
+				paced = 1;
+				break;
+			case 's':
+				speed = strtod(optarg,NULL);
+				paced = 1;
+				if (speed <= 0){
+					fprintf(stderr,"speed must be above 0\n");
+					return 1;
+				}
+				break;
+			case 'k':
+				keep = 1;
+				break;
+			case 'h':
+				show_usage(argv[0]);
+				return 0;
+			default:
+				show_usage(argv[0]);
+				return 1;
+		}
+	}
+	if (argc-optind != 2){
+		show_usage(argv[0]);
+		return 1;
+	}
+	char *trace_path = argv[optind];
+	char *image_path = argv[optind+1];
+	char default_copy_path[PATH_MAX];
+	if (copy_path == NULL){
+		snprintf(default_copy_path,sizeof(default_copy_path),"%s.replay",image_path);
+		copy_path = default_copy_path;
+	}
+
+	//====== open everything ======
+	TRACE *trace = trace_open(trace_path);
+	if (trace == NULL){
+		fprintf(stderr,"could not open trace %s: %s\n",trace_path,strerror(errno));
+		return 1;
+	}
+	if (copy_image(image_path,copy_path) != 0){
+		fprintf(stderr,"could not copy %s to %s: %s\n",image_path,copy_path,strerror(errno));
+		trace_close(trace);
+		return 1;
+	}
+	sfs_t filesystem;
+	if (sfs_open_fs(&filesystem,copy_path,0) != 0){
+		fprintf(stderr,"could not open %s\n",copy_path);
+		trace_close(trace);
+		return 1;
+	}
+	dentry_cache = dcache_new(DENTRY_CACHE_SIZE);
+	if (dentry_cache == NULL){
+		perror("dcache_new");
+		sfs_close_fs(&filesystem,0);
+		trace_close(trace);
+		return 1;
+	}
+
+	//====== replay ======
+	struct trace_record record;
+	char name[TRACE_MAX_NAME];
+	char *buffer = NULL;
+	size_t buffer_size = 0;
+	uint64_t replayed = 0, failed = 0, skipped = 0;
+	uint64_t recorded_span = 0;
+	int op_ids[TRACE_OP_COUNT];
+	for (int i = 0; i < TRACE_OP_COUNT; i++) op_ids[i] = stats_register(trace_op_name(i));
+	uint64_t start = stats_now();
+	int result;
+	while ((result = trace_read(trace,&record,name)) == 1){
+		if (record.op >= TRACE_OP_COUNT || record.inode == STATS_INODE){
+			skipped++;
+			continue;
+		}
+		if (paced) wait_until(start,record.start_ns/speed);
+		recorded_span = record.start_ns+record.duration_ns;
+		uint64_t op_start = stats_now();
+		if (replay_record(&filesystem,&record,name,&buffer,&buffer_size) != 0) failed++;
+		uint64_t bytes = (record.op == TRACE_OP_READ || record.op == TRACE_OP_WRITE) ? record.size : 0;
+		stats_record(op_ids[record.op],stats_now()-op_start,bytes);
+		replayed++;
+	}
+	uint64_t elapsed = stats_now()-start;
+	if (result < 0) fprintf(stderr,"trace_read: %s, stopping early\n",strerror(errno));
+
+	//====== report ======
+	printf("replayed %lu requests in %.3fs (%.0f requests/s), %lu failed, %lu skipped\n",
+		replayed,elapsed/1e9,replayed/(elapsed/1e9),failed,skipped);
+	printf("recorded over %.3fs\n",recorded_span/1e9);
+	char *table = stats_format(NULL);
+	if (table != NULL) printf("%s",table);
+	free(table);
+	printf("\n");
+	sfs_print_io_report(&filesystem,stdout);
+
+	//====== cleanup ======
+	free(buffer);
+	free(inode_map.entries);
+	dcache_delete(dentry_cache);
+	trace_close(trace);
+	sfs_close_fs(&filesystem,0);
+	stats_cleanup();
+	if (!keep) unlink(copy_path);
+	return (result < 0);
+}
+static void show_usage(char *name){
+	printf("usage: %s [options] <trace> <filesystem image>\n",name);
+	printf("the image should be a copy of the one mountsfs was started on, it is copied again before replaying so it is left untouched\n");
+	printf(" -o / --output <path> : where the copy is made (default <filesystem image>.replay)\n");
+	printf(" -p / --paced : keep to the timing of the recording instead of going at full speed\n");
+	printf(" -s / --speed <factor> : paced, but <factor> times faster than the recording\n");
+	printf(" -k / --keep : keep the copy afterwards\n");
+}
+int copy_image(const char *source,const char *destination){
+	int source_fd = open(source,O_RDONLY);
+	if (source_fd < 0) return -1;
+	int destination_fd = open(destination,O_WRONLY | O_CREAT | O_TRUNC,0644);
+	if (destination_fd < 0){
+		close(source_fd);
+		return -1;
+	}
+	char buffer[1024*64];
+	for (;;){
+		ssize_t bytes_read = read(source_fd,buffer,sizeof(buffer));
+		if (bytes_read == 0) break;
+		if (bytes_read < 0) goto error;
+		for (ssize_t written = 0; written < bytes_read;){
+			ssize_t result = write(destination_fd,buffer+written,bytes_read-written);
+			if (result < 0) goto error;
+			written += result;
+		}
+	}
+	close(source_fd);
+	return close(destination_fd);
+
+	error:
+	int error = errno;
+	close(source_fd);
+	close(destination_fd);
+	errno = error;
+	return -1;
+}
+//does the libsfs work mountsfs would have done for the request, returns -1 if any of it failed
+//requests served from mountsfs's own caches (readdir, release, forget) have nothing to replay
+//removals happen straight away rather than waiting for the kernel to forget the inode
+int replay_record(sfs_t *filesystem,struct trace_record *record,const char *name,char **buffer,size_t *buffer_size){
+	uint64_t inode = inode_map_get(record->inode);
+	sfs_inode_t header;
+	switch (record->op){
+		case TRACE_OP_LOOKUP:{
+			uint64_t found = lookup_by_name(filesystem,inode,name,NULL);
+			//learn where the recorded inode ended up
+			if (found != (uint64_t)-1 && record->result != 0) inode_map_set(record->result,found);
+			return 0;
+		}
+		case TRACE_OP_GETATTR:
+		case TRACE_OP_ACCESS:
+			return sfs_read_inode_header(filesystem,inode,&header);
+		case TRACE_OP_OPEN:
+			//once to check it is not a directory, once for the permissions
+			if (sfs_read_inode_header(filesystem,inode,&header) != 0) return -1;
+			return sfs_read_inode_header(filesystem,inode,&header);
+		case TRACE_OP_SETATTR:
+			if (sfs_read_inode_header(filesystem,inode,&header) != 0) return -1;
+			if (record->flags & SETATTR_MODE) header.mode = record->mode;
+			if (sfs_write_inode_header(filesystem,inode,&header) != 0) return -1;
+			if (record->flags & SETATTR_SIZE) return sfs_file_resize(filesystem,inode,record->size,-1);
+			return 0;
+		case TRACE_OP_MKNOD:
+		case TRACE_OP_MKDIR:{
+			mode_t mode = (record->op == TRACE_OP_MKDIR) ? (record->mode | S_IFDIR) : record->mode;
+			//checked for first
+			if (lookup_by_name(filesystem,inode,name,NULL) != (uint64_t)-1) return -1;
+			uint64_t new_inode = sfs_inode_create(filesystem,name,mode,getuid(),getgid(),inode);
+			if (new_inode == (uint64_t)-1) return -1;
+			dcache_insert(dentry_cache,inode,name,new_inode);
+			if (record->result != 0) inode_map_set(record->result,new_inode);
+			return sfs_update_superblock(filesystem);
+		}
+		case TRACE_OP_UNLINK:
+		case TRACE_OP_RMDIR:
+			return remove_inode(filesystem,inode,name);
+		case TRACE_OP_RENAME:{
+			//recorded as old/new
+			char *new_name = strchr(name,'/');
+			if (new_name == NULL) return -1;
+			char old_name[TRACE_MAX_NAME];
+			memcpy(old_name,name,new_name-name);
+			old_name[new_name-name] = '\0';
+			return rename_inode(filesystem,inode,old_name,inode_map_get(record->offset),new_name+1,record->flags);
+		}
+		case TRACE_OP_READ:
+		case TRACE_OP_WRITE:
+			//====== grow the buffer to fit the request ======
+			if (record->size > *buffer_size){
+				char *new_buffer = realloc(*buffer,record->size);
+				if (new_buffer == NULL) return -1;
+				memset(new_buffer,'x',record->size);
+				*buffer = new_buffer;
+				*buffer_size = record->size;
+			}
+			if (record->op == TRACE_OP_READ){
+				return (sfs_file_read(filesystem,inode,record->offset,*buffer,record->size) == (size_t)-1) ? -1 : 0;
+			}
+			if (sfs_file_grow_for_write(filesystem,inode,record->offset,record->size) != 0) return -1;
+			return (sfs_file_write(filesystem,inode,record->offset,*buffer,record->size) == (size_t)-1) ? -1 : 0;
+		case TRACE_OP_OPENDIR:
+			//opendir reads every entry up front
+			if (sfs_read_inode_header(filesystem,inode,&header) != 0) return -1;
+			uint64_t *children = read_all_pointers(filesystem,inode,header.pointer_count);
+			if (children == NULL) return -1;
+			for (uint64_t i = 0; i < header.pointer_count; i++){
+				sfs_inode_t child_header;
+				if (sfs_read_inode_header(filesystem,children[i],&child_header) != 0) return -1;
+			}
+			return 0;
+		default:
+			return 0;
+	}
+}
+//the same as mountsfs, every pointer of an inode in one go
+uint64_t *read_all_pointers(sfs_t *filesystem,uint64_t inode,uint64_t pointer_count){
+	if (pointer_count > pointer_buffer_size){
+		uint64_t *new_buffer = realloc(pointer_buffer,sizeof(uint64_t)*pointer_count);
+		if (new_buffer == NULL) return NULL;
+		pointer_buffer = new_buffer;
+		pointer_buffer_size = pointer_count;
+	}
+	if (sfs_inode_get_pointers(filesystem,inode,0,pointer_count,pointer_buffer) != 0) return NULL;
+	return pointer_buffer;
+}
+//through the dentry cache like mountsfs's inode_lookup_by_name
+uint64_t lookup_by_name(sfs_t *filesystem,uint64_t parent,const char *name,uint64_t *pointer_index_return){
+	uint64_t cached_inode;
+	int cached = dcache_lookup(dentry_cache,parent,name,&cached_inode);
+	if (cached && (cached_inode == DCACHE_NEGATIVE || pointer_index_return == NULL)) return cached_inode;
+	sfs_inode_t parent_header;
+	if (sfs_read_inode_header(filesystem,parent,&parent_header) != 0) return (uint64_t)-1;
+	uint64_t *inodes = read_all_pointers(filesystem,parent,parent_header.pointer_count);
+	if (inodes == NULL) return (uint64_t)-1;
+	for (uint64_t i = 0; i < parent_header.pointer_count; i++){
+		uint64_t inode = inodes[i];
+		//a cache hit only has to find where the inode is, not read every header
+		if (cached){
+			if (inode != cached_inode) continue;
+			*pointer_index_return = i;
+			return inode;
+		}
+		sfs_inode_t header;
+		if (sfs_read_inode_header(filesystem,inode,&header) != 0) return (uint64_t)-1;
+		if (strcmp(header.name,name) == 0){
+			if (pointer_index_return != NULL) *pointer_index_return = i;
+			dcache_insert(dentry_cache,parent,name,inode);
+			return inode;
+		}
+	}
+	if (!cached) dcache_insert(dentry_cache,parent,name,DCACHE_NEGATIVE);
+	return (uint64_t)-1;
+}
+//unlink and rmdir
+int remove_inode(sfs_t *filesystem,uint64_t parent,const char *name){
+	uint64_t index;
+	uint64_t inode = lookup_by_name(filesystem,parent,name,&index);
+	if (inode == (uint64_t)-1) return -1;
+	//the same steps as mountsfs, with the reclaim done straight away rather than by its thread
+	if (sfs_inode_remove_pointer(filesystem,parent,index) != 0) return -1;
+	dcache_insert(dentry_cache,parent,name,DCACHE_NEGATIVE);
+	dcache_remove_parent(dentry_cache,inode);
+	if (sfs_orphan_inode(filesystem,inode) != 0) return -1;
+	return (sfs_reclaim_inode(filesystem,inode,UINT64_MAX) == 1) ? 0 : -1;
+}
+//the same steps as mountsfs's rename, a replaced inode being reclaimed straight away
+int rename_inode(sfs_t *filesystem,uint64_t parent,const char *name,uint64_t new_parent,const char *new_name,unsigned int flags){
+	uint64_t index;
+	uint64_t inode = lookup_by_name(filesystem,parent,name,&index);
+	if (inode == (uint64_t)-1) return -1;
+	uint64_t target_index;
+	uint64_t target = lookup_by_name(filesystem,new_parent,new_name,&target_index);
+	if (target == inode) return 0;
+	if (flags & RENAME_EXCHANGE){
+		if (target == (uint64_t)-1) return -1;
+		if (sfs_inode_exchange(filesystem,parent,index,new_parent,target_index) != 0) return -1;
+		dcache_insert(dentry_cache,parent,name,target);
+		dcache_insert(dentry_cache,new_parent,new_name,inode);
+		return 0;
+	}
+	if (sfs_inode_move(filesystem,inode,parent,index,new_parent,(target == (uint64_t)-1) ? (uint64_t)-1 : target_index,new_name) != 0) return -1;
+	dcache_insert(dentry_cache,parent,name,DCACHE_NEGATIVE);
+	dcache_insert(dentry_cache,new_parent,new_name,inode);
+	if (target == (uint64_t)-1) return sfs_update_superblock(filesystem);
+	//already on the orphan list
+	dcache_remove_parent(dentry_cache,target);
+	return (sfs_reclaim_inode(filesystem,target,UINT64_MAX) == 1) ? 0 : -1;
+}
+
+//====== inode map ======
+//open addressing, recorded inodes that were never remapped are their own replayed inode
+static size_t _inode_map_slot(uint64_t recorded,size_t size){
+	size_t slot = (recorded*0x9E3779B97F4A7C15ULL) & (size-1);
+	while (inode_map.entries[slot].recorded != 0 && inode_map.entries[slot].recorded != recorded){
+		slot = (slot+1) & (size-1);
+	}
+	return slot;
+}
+uint64_t inode_map_get(uint64_t recorded){
+	if (inode_map.size == 0) return recorded;
+	struct inode_map_entry *entry = &inode_map.entries[_inode_map_slot(recorded,inode_map.size)];
+	return (entry->recorded == recorded) ? entry->replayed : recorded;
+}
+int inode_map_set(uint64_t recorded,uint64_t replayed){
+	//====== keep it at most half full ======
+	if ((inode_map.used+1)*2 > inode_map.size){
+		size_t new_size = (inode_map.size == 0) ? INODE_MAP_INITIAL_SIZE : inode_map.size*2;
+		struct inode_map_entry *old_entries = inode_map.entries;
+		size_t old_size = inode_map.size;
+		inode_map.entries = calloc(new_size,sizeof(struct inode_map_entry));
+		if (inode_map.entries == NULL){
+			inode_map.entries = old_entries;
+			return -1;
+		}
+		inode_map.size = new_size;
+		for (size_t i = 0; i < old_size; i++){
+			if (old_entries[i].recorded == 0) continue;
+			inode_map.entries[_inode_map_slot(old_entries[i].recorded,new_size)] = old_entries[i];
+		}
+		free(old_entries);
+	}
+	struct inode_map_entry *entry = &inode_map.entries[_inode_map_slot(recorded,inode_map.size)];
+	if (entry->recorded == 0) inode_map.used++;
+	entry->recorded = recorded;
+	entry->replayed = replayed;
+	return 0;
+}
+//sleeps until offset_ns after start (both CLOCK_MONOTONIC)
+void wait_until(uint64_t start,uint64_t offset_ns){
+	uint64_t target = start+offset_ns;
+	struct timespec deadline = {
+		.tv_sec = target/1000000000,
+		.tv_nsec = target%1000000000,
+	};
+	while (clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&deadline,NULL) == EINTR);
+}